@@ -10,5 +10,6 @@
 @interface PhysicsEngine : NSObject {}
 
 +(NSArray *) findAllStates:(NSArray *)ballPositions withFingerPosition:(CGPoint)fingerPosition;
++(void) aimAt:(NSArray *)ballPositions withFingerPosition:(CGPoint)fingerPosition;
 
 @end
\ No newline at end of file
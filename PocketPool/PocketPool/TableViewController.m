@@ -111,6 +111,7 @@
         self.fingerPosition = CGPointMake(self.fingerPosition.x + translation.x, self.fingerPosition.y + translation.y);
         [recognizer setTranslation:CGPointMake(0, 0) inView:self.tableView];
     }
+    [PhysicsEngine aimAt:self.ballPositions withFingerPosition:[TableView convertDisplayPointToPoint:self.fingerPosition]];
     self.ringImageView.center = self.fingerPosition;
     [self rerenderTableImage];
     self.ringImageView.hidden = NO;
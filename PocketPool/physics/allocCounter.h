@@ -0,0 +1,81 @@
+//Counting replacements for every global operator new and delete, so tests and benchmarks can tell what a
+//piece of code allocated
+//All the forms are replaced, array and nothrow included, so nothing slips past uncounted and every delete frees
+//what one of these malloced
+//Include it from the one file that has main, since it defines the operators
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+//How many times operator new was called, and how many bytes it was asked for in all
+std::atomic<long> allocations(0);
+std::atomic<long> allocated(0);
+
+void *countedAlloc(size_t size) noexcept {
+  ++allocations;
+  allocated += size;
+  return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size) {
+  void *p = countedAlloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) {
+  void *p = countedAlloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+
+//GCC 11 on warns that free gets a pointer from operator new, not seeing that this operator new is malloc
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  free(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+  free(p);
+}
+#endif
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
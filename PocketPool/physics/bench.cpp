@@ -0,0 +1,289 @@
+//Benchmarks for the physics engine: fixed, seeded scenarios, one line of JSON per scenario on stdout
+//  g++ -std=c++11 -O2 -pthread bench.cpp -o bench && ./bench [seconds per scenario] [seed]
+//Each line also says how big the scenario's trajectories are stored as double and as float, and the furthest
+//apart the two ever put a ball, then how fast the shots go with the kernels in float and how far that leaves a
+//ball from where double does. That's basicSimulation<float>, even on builds where floatSimulation is double
+//Built with -DPOOL_TRACE as well, each line also gets the engine's counts of pair tests and events per shot
+#include "engine.h"
+#include "allocCounter.h"
+#include <string>
+
+//Uniform numbers straight from mt19937, so a seed gives the same tables everywhere, unlike std's distributions
+struct seeded {
+  std::mt19937 gen;
+
+  seeded(unsigned seed) : gen(seed) {
+  }
+  double uniform(double lo, double hi) {
+    return lo + (hi - lo) * (gen() / 4294967296.0);
+  }
+};
+
+//A named set of tables, each one shot as is: the balls already have their velocities
+struct scenario {
+  std::string name;
+  std::vector<std::vector<ball> > shots;
+};
+
+const double R = nineFoot::BALL_RADIUS;
+
+bool fits(const std::vector<ball> &balls, vector p) {
+  for(size_t i = 0; i < balls.size(); ++i) {
+    if (abs(balls[i].pos - p) < 2 * R + 1e-4) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//Adds a ball somewhere free inside the box, or nowhere if it can't find room
+void place(seeded &r, std::vector<ball> &balls, double x0, double y0, double x1, double y1) {
+  x0 = std::max(x0, R + 1e-3), y0 = std::max(y0, R + 1e-3);
+  x1 = std::min(x1, nineFoot::WIDTH - R - 1e-3), y1 = std::min(y1, nineFoot::HEIGHT - R - 1e-3);
+  for(int tries = 0; tries < 1000; ++tries) {
+    vector p(r.uniform(x0, x1), r.uniform(y0, y1));
+    if (fits(balls, p)) {
+      balls.push_back(ball(p, balls.size()));
+      return;
+    }
+  }
+}
+
+vector polar(double speed, double angle) {
+  return speed * vector(cos(angle), sin(angle));
+}
+
+//Cue ball into a full rack, hard
+scenario breaks(seeded &r, int count) {
+  scenario s;
+  s.name = "break";
+  for(int k = 0; k < count; ++k) {
+    std::vector<ball> balls(1, ball(vector(0.6, 0.62), 0));
+    balls[0].vel = polar(r.uniform(5, 7), r.uniform(-0.02, 0.02));
+    double d = 2 * R + 1e-4;
+    for(int row = 0; row < 5; ++row) {
+      for(int c = 0; c <= row; ++c) {
+        balls.push_back(ball(vector(1.8 + row * d * sqrt(3.) / 2, nineFoot::HEIGHT / 2 + (c - row / 2.) * d), balls.size()));
+      }
+    }
+    s.shots.push_back(balls);
+  }
+  return s;
+}
+
+//A few balls left anywhere on the table, a medium shot in any direction
+scenario endgame(seeded &r, int count) {
+  scenario s;
+  s.name = "endgame";
+  for(int k = 0; k < count; ++k) {
+    std::vector<ball> balls;
+    int n = 3 + k % 2;
+    for(int i = 0; i < n; ++i) {
+      place(r, balls, 0, 0, nineFoot::WIDTH, nineFoot::HEIGHT);
+    }
+    balls[0].vel = polar(r.uniform(1, 3), r.uniform(0, 2 * M_PI));
+    s.shots.push_back(balls);
+  }
+  return s;
+}
+
+//Three tight clumps of five, the cue ball sent into one of them
+scenario clustered(seeded &r, int count) {
+  scenario s;
+  s.name = "clustered";
+  for(int k = 0; k < count; ++k) {
+    std::vector<ball> balls;
+    place(r, balls, 0, 0, nineFoot::WIDTH, nineFoot::HEIGHT);
+    vector centres[3];
+    for(int c = 0; c < 3; ++c) {
+      centres[c] = vector(r.uniform(0.3, nineFoot::WIDTH - 0.3), r.uniform(0.3, nineFoot::HEIGHT - 0.3));
+      for(int i = 0; i < 5; ++i) {
+        place(r, balls, centres[c].X - 3 * R, centres[c].Y - 3 * R, centres[c].X + 3 * R, centres[c].Y + 3 * R);
+      }
+    }
+    balls[0].vel = polar(r.uniform(3, 5), arg(centres[k % 3] - balls[0].pos));
+    s.shots.push_back(balls);
+  }
+  return s;
+}
+
+//The cue ball hit as hard as it gets, so it goes round the table off rail after rail, past a couple of balls
+scenario multiRail(seeded &r, int count) {
+  scenario s;
+  s.name = "multi_rail";
+  for(int k = 0; k < count; ++k) {
+    std::vector<ball> balls;
+    for(int i = 0; i < 3; ++i) {
+      place(r, balls, 0, 0, nineFoot::WIDTH, nineFoot::HEIGHT);
+    }
+    balls[0].vel = polar(r.uniform(6, 8), r.uniform(0, 2 * M_PI));
+    s.shots.push_back(balls);
+  }
+  return s;
+}
+
+//n balls on a jittered grid, all of them moving at once
+scenario stress(seeded &r, int count, int n) {
+  scenario s;
+  s.name = "stress_" + std::to_string(n);
+  int cols = (int) sqrt(n * 2.0) + 1;
+  double dx = (nineFoot::WIDTH - 0.2) / cols, dy = (nineFoot::HEIGHT - 0.2) / (n / cols + 1);
+  double jitter = std::max(0.0, std::min(dx, dy) / 2 - R - 1e-3);
+  for(int k = 0; k < count; ++k) {
+    std::vector<ball> balls;
+    for(int i = 0; i < n; ++i) {
+      vector p(0.1 + (i % cols) * dx + r.uniform(-jitter, jitter), 0.1 + (i / cols) * dy + r.uniform(-jitter, jitter));
+      balls.push_back(ball(p, i));
+      balls.back().vel = vector(r.uniform(-1, 1), r.uniform(-1, 1));
+    }
+    s.shots.push_back(balls);
+  }
+  return s;
+}
+
+//Shoots one table until everything stops, counting the steps and how many of them were collisions
+template <class Kernel>
+void shoot(basicSimulation<Kernel> &sim, std::vector<ball> &balls, const std::vector<ball> &table, long &steps, long &events) {
+  balls = table;
+  state s;
+  s.time = 0;
+  s.numballs = balls.size();
+  s.balls = balls.data();
+  initSimulation(sim, s);
+  while (step(sim, MAX_ANIMATION_LENGTH)) {
+    ++steps;
+    events += sim.lastEvent.type != -1;
+  }
+}
+
+//Records each of the scenario's shots as a trajectory and as a floatTrajectory, for how much smaller the float
+//one is and how far apart the two put a ball at any frame. Pocketed balls are compared by where they went in
+void compareFloat(const scenario &sc, double &bytes, double &floatBytes, double &worst) {
+  simulation sim;
+  trajectory exact;
+  floatTrajectory rounded;
+  std::vector<ball> a, b;
+  bytes = floatBytes = worst = 0;
+  for(size_t k = 0; k < sc.shots.size(); ++k) {
+    std::vector<ball> balls = sc.shots[k];
+    state s;
+    s.time = 0;
+    s.numballs = balls.size();
+    s.balls = balls.data();
+    recordTrajectory(sim, s, MAX_ANIMATION_LENGTH, exact);
+    recordTrajectory(sim, s, MAX_ANIMATION_LENGTH, rounded);
+    bytes += exact.keys.size() * sizeof(exact.keys[0]);
+    floatBytes += rounded.keys.size() * sizeof(rounded.keys[0]);
+    a.resize(s.numballs), b.resize(s.numballs);
+    for(double t = 0; t < exact.end + DEFAULT_TIME_STEP; t += DEFAULT_TIME_STEP) {
+      trajectoryAt(exact, t, a.data());
+      trajectoryAt(rounded, t, b.data());
+      for(int i = 0; i < s.numballs; ++i) {
+        worst = std::max(worst, abs(a[i].pos - b[i].pos));
+      }
+    }
+  }
+  bytes /= sc.shots.size(), floatBytes /= sc.shots.size();
+}
+
+//Shoots each of the scenario's tables with the double and the float kernels, for how far apart the two leave a
+//ball. Balls that went in count by whether they went in the same pocket
+double compareKernels(const scenario &sc) {
+  simulation sim;
+  basicSimulation<float> rounded;
+  std::vector<ball> a, b;
+  long steps = 0, events = 0;
+  double worst = 0;
+  for(size_t k = 0; k < sc.shots.size(); ++k) {
+    shoot(sim, a, sc.shots[k], steps, events);
+    shoot(rounded, b, sc.shots[k], steps, events);
+    for(size_t i = 0; i < a.size(); ++i) {
+      const ball &p = sim.balls[i], &q = rounded.balls[i];
+      worst = std::max(worst, p.inPocket != q.inPocket ? HUGE_VAL : (p.inPocket == -1 ? abs(p.pos - q.pos) : 0));
+    }
+  }
+  return worst;
+}
+
+//Shoots every table of the scenario at least once, and keeps going round them until seconds have gone by
+//Returns how many shots that was and how long they took, adding up their steps and events
+template <class Kernel>
+long keepShooting(basicSimulation<Kernel> &sim, const scenario &sc, double seconds, double &elapsed, long &steps, long &events) {
+  std::vector<ball> balls;
+  long shots = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  elapsed = 0;
+  while (shots < (long) sc.shots.size() || elapsed < seconds) {
+    shoot(sim, balls, sc.shots[shots % sc.shots.size()], steps, events);
+    ++shots;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  return shots;
+}
+
+void run(const scenario &sc, double seconds) {
+  std::vector<ball> balls;
+  long steps = 0, events = 0;
+
+  //A first shot on a new simulation pays for all its buffers, after that they're reused
+  long before = allocated;
+  {
+    simulation cold;
+    shoot(cold, balls, sc.shots[0], steps, events);
+  }
+  long coldBytes = allocated - before;
+
+  //The float kernels, and the trajectories kept in float, go first so they stay out of the trace's counts
+  double trajectoryBytes, floatBytes, floatError;
+  compareFloat(sc, trajectoryBytes, floatBytes, floatError);
+  double kernelError = compareKernels(sc);
+  basicSimulation<float> rounded;
+  double floatElapsed;
+  long floatShots = keepShooting(rounded, sc, seconds, floatElapsed, steps, events);
+
+  simulation sim;
+  shoot(sim, balls, sc.shots[0], steps, events);
+  steps = events = 0;
+  before = allocated;
+  resetTrace();
+  double elapsed;
+  long shots = keepShooting(sim, sc, seconds, elapsed, steps, events);
+  long warmBytes = allocated - before;
+
+  printf("{\"scenario\": \"%s\", \"balls\": %d, \"shots\": %ld, \"steps_per_shot\": %.1f, \"events_per_shot\": %.1f, "
+         "\"ns_per_step\": %.1f, \"shots_per_sec\": %.1f, \"bytes_first_shot\": %ld, \"bytes_per_shot\": %.1f, "
+         "\"trajectory_bytes\": %.0f, \"float_trajectory_bytes\": %.0f, \"float_max_error_m\": %.2e, "
+         "\"float_kernel_shots_per_sec\": %.1f, \"float_kernel_max_error_m\": %.2e",
+         sc.name.c_str(), (int) sc.shots[0].size(), shots, (double) steps / shots, (double) events / shots,
+         elapsed * 1e9 / std::max(steps, 1L), shots / elapsed, coldBytes, (double) warmBytes / shots,
+         trajectoryBytes, floatBytes, floatError, floatShots / floatElapsed, kernelError);
+#ifdef POOL_TRACE
+  traceLog &log = threadTrace();
+  printf(", \"pair_tests_per_shot\": %.1f, \"pruned_per_shot\": %.1f, \"ball_events_per_shot\": %.1f, "
+         "\"pocket_events_per_shot\": %.1f, \"cushion_events_per_shot\": %.1f",
+         (double) log.pairTests / shots, (double) log.pairsPruned / shots, (double) log.events[0] / shots,
+         (double) log.events[1] / shots, (double) log.events[2] / shots);
+#endif
+  printf("}\n");
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 1;
+  unsigned seed = argc > 2 ? atoi(argv[2]) : 1;
+
+  seeded r(seed);
+  std::vector<scenario> scenarios;
+  scenarios.push_back(breaks(r, 32));
+  scenarios.push_back(endgame(r, 32));
+  scenarios.push_back(clustered(r, 32));
+  scenarios.push_back(multiRail(r, 32));
+  const int sizes[] = {50, 100, 200, 500};
+  for(int k = 0; k < 4; ++k) {
+    scenarios.push_back(stress(r, 4, sizes[k]));
+  }
+  for(size_t k = 0; k < scenarios.size(); ++k) {
+    run(scenarios[k], seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,3282 @@
+/*IMPORTANT API TO KNOW
+ball structure = vector pos, vector vel, int id, int inPocket (-1 if not in pocket)
+state structure = double time, int numballs, ball *balls
+
+Everything below takes the table it's for as a template parameter: nineFoot (the default), eightFoot, sevenFoot,
+snooker, or tableSpec<your own preset>. eg allStates<snooker>(beginning)
+
+A simulation can also run on cushions and pockets read in at runtime, with the Spec still giving the ball size
+    bool loadOutline(const char *path, double ballRadius, tableOutline &out)
+    sim.outline = &out
+
+Given a beginning state with time = 0, return a giant list of states that are the states at multiples of a time DEFAULT_TIME_STEP
+until everything stops
+    state* allStates(state beginning, int *numFrames)
+
+Or as snapshots that own their balls, fixedState<N> for up to N balls stored inline or dynamicState for any number
+    int allStates(state beginning, std::vector<fixedState<N> > &frames)
+
+Same thing, but hands each frame to a callback (or a frameRing through pushFrame) instead of allocating them
+    int streamStates(simulation &sim, state beginning, frameSink sink, void *context)
+Anything that takes a simulation takes a floatSimulation too, and anything that takes a shotPool a floatShotPool,
+which prune pairs and cushions in float, eight to a vector, and still play out exactly the same shot: every
+collision time is worked out in double either way. Built without AVX they're the same as a simulation and a
+shotPool, since there float doesn't make up for keeping its rounded copies
+
+Same frames again, but made on a thread of their own and pulled off as they come, so playback needn't wait
+for the whole shot. startShot again (or cancelShot) stops the one before
+    void startShot(asyncShot &shot, state beginning, int capacity)
+    bool pullFrame(asyncShot &shot, state &frame, ball *storage)
+    bool shotOver(const asyncShot &shot)
+
+Records a shot as just its collisions, then gets the table at any time t from that in O(log collisions)
+    void recordTrajectory(simulation &sim, state beginning, double duration, trajectory &out)
+    state trajectoryAt(const trajectory &tr, double t, ball *storage)
+A floatTrajectory records and seeks the same way in half the memory, to within about a micrometre
+
+The same, but giving up once a budget of time, steps or collisions runs out, for previews that have to be quick
+Returns whether the shot got as far as the balls stopping
+    bool recordPreview(simulation &sim, state beginning, double duration, const previewBudget &budget, trajectory &out)
+
+Gives the best possible to hit the cue ball (balls[0]) at
+idArray is the vector of the id's of balls that we can possibly sink
+-10 is the default "we have no good move" value
+    double getBestMove(state cur, std::vector<int> idArray)
+    
+Assuming you can hit any ball
+    double getBestMoveAll(state cur)
+
+Same as getBestMove, but plays every candidate noise.samples times with angle and speed errors and picks the
+one that goes in most often. best gets its chance of going in, with a 95% confidence interval
+    double getBestMoveRobust(shotPool &pool, state cur, std::vector<int> idArray, double speed, const shotNoise &noise, shotScore *best, int cushions)
+
+Finds the cue angle and speed that send ball target into pocket, simulating a few tens of trials at most
+    shotSolution solveShot(simulation &sim, state cur, int target, int pocket, double speed, int maxSimulations)
+
+Plans opts.depth shots ahead with a beam search over simulated outcomes, so it can play for position
+Returns the first shot's angle, line gets the whole run of shots
+    double planAhead(shotPool &pool, state cur, const lookahead &opts, std::vector<candidate> *line)
+
+Given an angle at which we strike the cue ball, give the vector position of the ghost of the cue ball upon first collision
+    vector getGhostImage(state cur, double angle){
+
+Built with -DPOOL_TRACE, counts pair tests, pruned pairs, events and steps, and keeps each thread's last events
+    void dumpTrace(FILE *out)
+    void resetTrace()
+
+Simulates the same table with the cue ball hit at each of numShots velocities, spread over a pool of threads
+outs[k] gets where every ball ended up after shot k
+    void simulateBatch(shotPool &pool, state beginning, const vector *cueVels, int numShots, outcome *outs, const stopRule *stops)
+
+Just the outcome of one shot, no frames: first ball hit, what went in, where everything stopped. stop ends it as
+soon as the answer's known, eg STOP_SCRATCH, STOP_POTTED or STOP_WRONG_FIRST
+    void simulateOutcome(simulation &sim, std::vector<ball> &balls, state beginning, vector cueVel, const stopRule &stop, outcome &out)
+
+While the player aims, speculatively records the shots around their aim on a background thread, so that on
+release the trajectory is usually already there
+    void aimAt(aimSession &s, state cur, double angle, double power)
+    std::shared_ptr<const trajectory> releaseAim(aimSession &s, state cur, double angle, double power)
+
+*/
+
+#ifndef POOL_ENGINE_H
+#define POOL_ENGINE_H
+
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <complex>
+#include <math.h>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+typedef std::complex<double> vector;
+
+#define DEFAULT_TIME_STEP 0.04
+#define X real()
+#define Y imag()
+
+const double FRICTION = 0.1;
+const double RAIL_RES = 0.8;
+const double BALL_RES = 0.95;
+//Balls closer than this are in contact, so their collisions are resolved together instead of one step each
+const double CONTACT_GAP = 1e-6;
+//So are balls whose gap closes within this many seconds of a collision next to them, as in a rack set up loose
+const double CLUSTER_TIME = 1e-3;
+
+const double MAX_ANIMATION_LENGTH = 20;
+
+//Table presets: the measurements that make one kind of table different from another
+//Don't use these directly, use their tableSpec (nineFoot etc. at the bottom), which works out the rest
+struct nineFootTable {
+  static constexpr double CORNER_WITHIN_WALL = .024; //perp distance between center of pocket and the rail
+  static constexpr double CORNER_WALL_MISSING = .106; //amount of wall that's missing in each direction around the corner
+  static constexpr double CORNER_SLOPE = 1; //slope of the top left corner wall
+  static constexpr double CORNER_RADIUS = .096;
+
+  static constexpr double SIDE_WALL_MISSING = .096; //amount of wall missing on either side around the side
+  static constexpr double SIDE_WITHIN_WALL = .11;
+  static constexpr double SIDE_SLOPE = 5;
+  static constexpr double SIDE_RADIUS = .096;
+
+  static constexpr double BALL_RADIUS = .0285;
+  static constexpr double WIDTH = 2.5;
+  static constexpr double HEIGHT = 1.25;
+};
+
+//Bar tables: same balls and pockets, smaller bed
+struct eightFootTable : nineFootTable {
+  static constexpr double WIDTH = 2.24;
+  static constexpr double HEIGHT = 1.12;
+};
+
+struct sevenFootTable : nineFootTable {
+  static constexpr double WIDTH = 1.98;
+  static constexpr double HEIGHT = .99;
+};
+
+//12ft snooker table, with smaller balls and tighter pockets
+struct snookerTable {
+  static constexpr double CORNER_WITHIN_WALL = .022;
+  static constexpr double CORNER_WALL_MISSING = .098;
+  static constexpr double CORNER_SLOPE = 1;
+  static constexpr double CORNER_RADIUS = .088;
+
+  static constexpr double SIDE_WALL_MISSING = .088;
+  static constexpr double SIDE_WITHIN_WALL = .1;
+  static constexpr double SIDE_SLOPE = 5;
+  static constexpr double SIDE_RADIUS = .088;
+
+  static constexpr double BALL_RADIUS = .02625;
+  static constexpr double WIDTH = 3.569;
+  static constexpr double HEIGHT = 1.778;
+};
+
+//A pocket: a ball drops in once its center gets within reach of (x, y)
+struct pocketSpec {
+  double x, y, radius, reach;
+};
+
+//A cushion from (x1, y1) to (x2, y2). The table is on the side of the normal (y1 - y2, x2 - x1), so going round
+//the table the cushions all run the same way
+struct cushionSpec {
+  double x1, y1, x2, y2;
+};
+
+struct aimPoint {
+  double x, y;
+};
+
+//sqrt that works at compile time, by Newton's method
+constexpr double constSqrt(double x, double guess = 1, int steps = 40) {
+  return steps == 0 ? guess : constSqrt(x, (guess + x / guess) / 2, steps - 1);
+}
+
+//Where the line through (x, y) going (dx, dy) comes closest to pocket p
+constexpr double footX(double x, double y, double dx, double dy, pocketSpec p) {
+  return x + dx * ((p.x - x) * dx + (p.y - y) * dy) / (dx * dx + dy * dy);
+}
+
+constexpr double footY(double x, double y, double dx, double dy, pocketSpec p) {
+  return y + dy * ((p.x - x) * dx + (p.y - y) * dy) / (dx * dx + dy * dy);
+}
+
+//A pocket wall, running from the end of the rail at (x, y) along (dx, dy) to pocket p if out, or back if not
+//It stops where it passes closest to the pocket, since a ball that far in has already dropped
+constexpr cushionSpec pocketWall(double x, double y, double dx, double dy, pocketSpec p, bool out) {
+  return out ? cushionSpec{x, y, footX(x, y, dx, dy, p), footY(x, y, dx, dy, p)}
+             : cushionSpec{footX(x, y, dx, dy, p), footY(x, y, dx, dy, p), x, y};
+}
+
+//Everything about a table's shape, worked out at compile time from one of the presets above
+//The simulation and planner take one of these as a template parameter, so they get compiled for each kind of
+//table with all of this as constants instead of setting it up on every call
+template <class T>
+struct tableSpec : T {
+  //Pockets are labeled as such - top row is 012, bottom row is 345
+  static constexpr pocketSpec POCKETS[6] = {
+    {-T::CORNER_WITHIN_WALL, -T::CORNER_WITHIN_WALL, T::CORNER_RADIUS, constSqrt(4 * T::BALL_RADIUS * (T::CORNER_RADIUS - T::BALL_RADIUS))},
+    {T::WIDTH / 2, -T::SIDE_WITHIN_WALL, T::SIDE_RADIUS, constSqrt(4 * T::BALL_RADIUS * (T::SIDE_RADIUS - T::BALL_RADIUS))},
+    {T::WIDTH + T::CORNER_WITHIN_WALL, -T::CORNER_WITHIN_WALL, T::CORNER_RADIUS, constSqrt(4 * T::BALL_RADIUS * (T::CORNER_RADIUS - T::BALL_RADIUS))},
+    {-T::CORNER_WITHIN_WALL, T::HEIGHT + T::CORNER_WITHIN_WALL, T::CORNER_RADIUS, constSqrt(4 * T::BALL_RADIUS * (T::CORNER_RADIUS - T::BALL_RADIUS))},
+    {T::WIDTH / 2, T::HEIGHT + T::SIDE_WITHIN_WALL, T::SIDE_RADIUS, constSqrt(4 * T::BALL_RADIUS * (T::SIDE_RADIUS - T::BALL_RADIUS))},
+    {T::WIDTH + T::CORNER_WITHIN_WALL, T::HEIGHT + T::CORNER_WITHIN_WALL, T::CORNER_RADIUS, constSqrt(4 * T::BALL_RADIUS * (T::CORNER_RADIUS - T::BALL_RADIUS))}
+  };
+
+  //The cushions in order round the table, clockwise from the top left pocket: each rail, then the pocket walls
+  //either side of the next pocket. The top left corner's pocket walls run along (1, CORNER_SLOPE) from
+  //(0, CORNER_WALL_MISSING) and along (CORNER_SLOPE, 1) from (CORNER_WALL_MISSING, 0); the rest are reflections
+  //of those or the side's
+  static constexpr cushionSpec CUSHIONS[18] = {
+    pocketWall(T::CORNER_WALL_MISSING, 0, T::CORNER_SLOPE, 1, POCKETS[0], false),
+    {T::CORNER_WALL_MISSING, 0, T::WIDTH / 2 - T::SIDE_WALL_MISSING, 0},
+    pocketWall(T::WIDTH / 2 - T::SIDE_WALL_MISSING, 0, 1, -T::SIDE_SLOPE, POCKETS[1], true),
+    pocketWall(T::WIDTH / 2 + T::SIDE_WALL_MISSING, 0, -1, -T::SIDE_SLOPE, POCKETS[1], false),
+    {T::WIDTH / 2 + T::SIDE_WALL_MISSING, 0, T::WIDTH - T::CORNER_WALL_MISSING, 0},
+    pocketWall(T::WIDTH - T::CORNER_WALL_MISSING, 0, T::CORNER_SLOPE, -1, POCKETS[2], true),
+    pocketWall(T::WIDTH, T::CORNER_WALL_MISSING, 1, -T::CORNER_SLOPE, POCKETS[2], false),
+    {T::WIDTH, T::CORNER_WALL_MISSING, T::WIDTH, T::HEIGHT - T::CORNER_WALL_MISSING},
+    pocketWall(T::WIDTH, T::HEIGHT - T::CORNER_WALL_MISSING, 1, T::CORNER_SLOPE, POCKETS[5], true),
+    pocketWall(T::WIDTH - T::CORNER_WALL_MISSING, T::HEIGHT, T::CORNER_SLOPE, 1, POCKETS[5], false),
+    {T::WIDTH - T::CORNER_WALL_MISSING, T::HEIGHT, T::WIDTH / 2 + T::SIDE_WALL_MISSING, T::HEIGHT},
+    pocketWall(T::WIDTH / 2 + T::SIDE_WALL_MISSING, T::HEIGHT, -1, T::SIDE_SLOPE, POCKETS[4], true),
+    pocketWall(T::WIDTH / 2 - T::SIDE_WALL_MISSING, T::HEIGHT, 1, T::SIDE_SLOPE, POCKETS[4], false),
+    {T::WIDTH / 2 - T::SIDE_WALL_MISSING, T::HEIGHT, T::CORNER_WALL_MISSING, T::HEIGHT},
+    pocketWall(T::CORNER_WALL_MISSING, T::HEIGHT, -T::CORNER_SLOPE, 1, POCKETS[3], true),
+    pocketWall(0, T::HEIGHT - T::CORNER_WALL_MISSING, -1, T::CORNER_SLOPE, POCKETS[3], false),
+    {0, T::HEIGHT - T::CORNER_WALL_MISSING, 0, T::CORNER_WALL_MISSING},
+    pocketWall(0, T::CORNER_WALL_MISSING, -1, -T::CORNER_SLOPE, POCKETS[0], true)
+  };
+
+  //Where getBestMove aims for each pocket: the near edge of the opening, the middle and the far edge
+  static constexpr double AIM_IN = T::CORNER_WALL_MISSING - 1.4 * T::BALL_RADIUS;
+  static constexpr aimPoint AIM_LOW[6] = {
+    {AIM_IN, 0}, {T::WIDTH / 2 - AIM_IN, 0}, {T::WIDTH - AIM_IN, 0},
+    {AIM_IN, T::HEIGHT}, {T::WIDTH / 2, T::HEIGHT}, {T::WIDTH - AIM_IN, T::HEIGHT}
+  };
+  static constexpr aimPoint AIM_MID[6] = {
+    {0, 0}, {T::WIDTH / 2, -T::SIDE_RADIUS / 2}, {T::WIDTH, 0},
+    {0, T::HEIGHT}, {T::WIDTH / 2, T::HEIGHT + T::SIDE_RADIUS / 2}, {T::WIDTH, T::HEIGHT}
+  };
+  static constexpr aimPoint AIM_HIGH[6] = {
+    {0, AIM_IN}, {T::WIDTH / 2 + AIM_IN, 0}, {T::WIDTH, AIM_IN},
+    {0, T::HEIGHT - AIM_IN}, {T::WIDTH / 2 + AIM_IN, T::HEIGHT}, {T::WIDTH, T::HEIGHT - AIM_IN}
+  };
+};
+
+template <class T> constexpr pocketSpec tableSpec<T>::POCKETS[6];
+template <class T> constexpr cushionSpec tableSpec<T>::CUSHIONS[18];
+template <class T> constexpr aimPoint tableSpec<T>::AIM_LOW[6];
+template <class T> constexpr aimPoint tableSpec<T>::AIM_MID[6];
+template <class T> constexpr aimPoint tableSpec<T>::AIM_HIGH[6];
+
+typedef tableSpec<nineFootTable> nineFoot;
+typedef tableSpec<eightFootTable> eightFoot;
+typedef tableSpec<sevenFootTable> sevenFoot;
+typedef tableSpec<snookerTable> snooker;
+
+//Structure that holds a ball object
+struct ball {
+  vector pos;
+  vector vel;
+  int id;
+  int inPocket; // 0 if not in pocket
+
+  ball() {
+  }
+  ball(vector _pos, int _id) {
+    pos = _pos;
+    vel = vector();
+    id = _id;
+    inPocket = -1;
+  }
+
+  //Time until friction brings the ball to rest
+  double stopTime() const {
+    return abs(vel) / FRICTION;
+  }
+
+  //Half the acceleration from friction, ie the s^2 term of the ball's path
+  vector decel() const {
+    double speed = abs(vel);
+    if (speed == 0) {
+      return vector();
+    }
+    return -FRICTION / 2 * vel / speed;
+  }
+
+  //Where the ball will be after dt, without moving it
+  vector posAt(double dt) const {
+    if (dt > stopTime()) {
+      dt = stopTime();
+    }
+    return pos + vel * dt + decel() * dt * dt;
+  }
+
+  //Moves the ball along its path exactly, slowing down at a constant rate FRICTION until it stops
+  void run(double dt) {
+    double speed = abs(vel);
+    if (speed == 0) {
+      return;
+    }
+    pos = posAt(dt);
+    double newSpeed = speed - FRICTION * dt;
+    if (newSpeed < 0) {
+      newSpeed = 0;
+    }
+    vel *= newSpeed / speed;
+  }
+};
+
+//Snapshot of the state of the table
+struct state {
+  double time;
+  int numballs;
+  ball *balls;
+};
+
+//A table that owns its balls, up to N of them kept inline, so copying one is a plain memcpy with nothing shared
+//and nothing allocated. For snapshots to search, branch or undo from. view() is the state the engine takes,
+//pointing into it, so it's only good while the fixedState is
+//Each ball takes 40 bytes, so a fixedState<16> is 656 bytes, about ten 64 byte cache lines
+template <int N>
+struct fixedState {
+  double time;
+  int numballs;
+  ball balls[N];
+
+  fixedState() : time(0), numballs(0) {
+  }
+  //Keeps the first N balls if s has more than that
+  explicit fixedState(const state &s) : time(s.time), numballs(std::min(s.numballs, N)) {
+    std::copy(s.balls, s.balls + numballs, balls);
+  }
+
+  state view() {
+    state s = {time, numballs, balls};
+    return s;
+  }
+  //False if it's already full
+  bool add(const ball &b) {
+    if (numballs == N) {
+      return false;
+    }
+    balls[numballs++] = b;
+    return true;
+  }
+};
+
+//The same for tables with more balls than are worth keeping inline. Copies allocate, but still share nothing
+struct dynamicState {
+  double time;
+  std::vector<ball> balls;
+
+  dynamicState() : time(0) {
+  }
+  explicit dynamicState(const state &s) : time(s.time), balls(s.balls, s.balls + s.numballs) {
+  }
+
+  state view() {
+    state s = {time, (int) balls.size(), balls.data()};
+    return s;
+  }
+  bool add(const ball &b) {
+    balls.push_back(b);
+    return true;
+  }
+};
+
+static_assert(std::is_trivially_copyable<fixedState<16> >::value, "fixedState has to copy as plain memory");
+
+//Take the dot product of two vectors
+inline double dot(vector a, vector b) {
+  return a.X * b.X + a.Y * b.Y;
+}
+
+//Lulz take the square of a number
+inline double square(double x) {
+  return x * x;
+}
+
+//Returns the projection of vector a onto vector b
+inline vector proj(vector a, vector b) {
+  return dot(a, b) / square(abs(b)) * b;
+}
+
+inline double min(double x, double y){
+  if(x < y){return x;}
+  else{return y;}
+}
+
+//Evaluates c[0] + c[1] s + ... + c[deg] s^deg
+inline double evalPoly(const double *c, int deg, double s) {
+  double ans = 0;
+  for(int k = deg; k >= 0; --k) {
+    ans = ans * s + c[k];
+  }
+  return ans;
+}
+
+//Finds every root of the polynomial in (lo, hi] in increasing order, returns how many there are
+//Splits the interval at the roots of the derivative so each piece is monotone, then bisects each piece
+inline int polyRoots(const double *c, int deg, double lo, double hi, double *roots) {
+  if (deg == 0) {
+    return 0;
+  }
+  if (deg == 1) {
+    if (c[1] == 0) return 0;
+    double r = -c[0] / c[1];
+    if (lo < r && r <= hi) {
+      roots[0] = r;
+      return 1;
+    }
+    return 0;
+  }
+  double deriv[4], bounds[6];
+  for(int k = 1; k <= deg; ++k) {
+    deriv[k - 1] = k * c[k];
+  }
+  int m = polyRoots(deriv, deg - 1, lo, hi, bounds + 1);
+  bounds[0] = lo;
+  bounds[m + 1] = hi;
+
+  int n = 0;
+  for(int k = 0; k <= m; ++k) {
+    double a = bounds[k], b = bounds[k + 1];
+    double fa = evalPoly(c, deg, a), fb = evalPoly(c, deg, b);
+    if (fb == 0) {
+      if (b > a) roots[n++] = b;
+    } else if (fa != 0 && (fa < 0) != (fb < 0)) {
+      for(int it = 0; it < 100 && b - a > 1e-13 * (1 + b); ++it) {
+        double mid = (a + b) / 2;
+        if ((evalPoly(c, deg, mid) < 0) == (fa < 0)) a = mid;
+        else b = mid;
+      }
+      roots[n++] = a;
+    }
+  }
+  return n;
+}
+
+//Given a gap polynomial (positive while apart), returns the first time in [0, horizon] it closes, or -1
+//A gap that is already closed only counts if it is still closing, so things that just bounced can separate
+inline double firstContact(const double *c, int deg, double horizon) {
+  if (c[0] <= 0) {
+    return c[1] < 0 ? 0 : -1;
+  }
+  if (horizon <= 0) {
+    return -1;
+  }
+  double roots[4], deriv[4];
+  for(int k = 1; k <= deg; ++k) {
+    deriv[k - 1] = k * c[k];
+  }
+  int n = polyRoots(c, deg, 0, horizon, roots);
+  for(int k = 0; k < n; ++k) {
+    if (evalPoly(deriv, deg - 1, roots[k]) < 0) {
+      return roots[k];
+    }
+  }
+  return -1;
+}
+
+//Calculates when ball a comes within dist of ball b, following both balls as
+//friction slows them down. Their paths are quadratic in time, so the gap is a quartic we solve
+//piece by piece until one and then the other ball stops. Used within collideBalls and collidePocket
+inline double collideHelper(ball a, ball b, double dt, double dist) {
+  double dist2 = dist * dist;
+
+  //Can't meet if they'd both have to roll further than they can before stopping
+  double reach = (square(abs(a.vel)) + square(abs(b.vel))) / (2 * FRICTION);
+  if (square(abs(a.pos - b.pos)) > square(dist + reach)) {
+    return -1;
+  }
+
+  double elapsed = 0;
+  while (elapsed < dt) {
+    double ta = a.stopTime(), tb = b.stopTime();
+    double piece = (ta == 0 || (tb != 0 && tb < ta)) ? tb : ta;
+    if (piece == 0) {
+      return -1;
+    }
+    piece = min(piece, dt - elapsed);
+    vector dp = a.pos - b.pos, dv = a.vel - b.vel, da = a.decel() - b.decel();
+    double c[5] = {dot(dp, dp) - dist2, 2 * dot(dp, dv), dot(dv, dv) + 2 * dot(dp, da), 2 * dot(dv, da), dot(da, da)};
+    double t = firstContact(c, 4, piece);
+    if (t != -1) {
+      return elapsed + t;
+    }
+    a.run(piece);
+    b.run(piece);
+    elapsed += piece;
+  }
+  return -1;
+}
+
+//Returns at what time the two balls collide
+template <class Spec>
+double collideBalls(ball a, ball b, double dt) {
+  return collideHelper(a, b, dt, 2 * Spec::BALL_RADIUS);
+}
+
+//Adjusts velocities when two balls collide
+inline void handleCollide(ball &a, ball &b) {
+  vector dd = b.pos - a.pos;
+  vector va = a.vel, vb = b.vel;
+  vector tang = vector(dd.Y, -dd.X);
+  vector vat = proj(va, tang), vbt = proj(vb, tang);
+  a.vel = vat + BALL_RES * (vb - vbt);
+  b.vel = vbt + BALL_RES * (va - vat);
+}
+
+//Adjusts velocities when a ball goes in a pocket
+inline void handleCollidePocket(ball &a, int pocketID) {
+  a.inPocket = pocketID;
+  //PROBABLY SHOULD DO SOMETHING HERE
+}
+
+//The app puts balls it couldn't find at x = 1000000
+inline bool onTable(state cur, int ballID){
+  return cur.balls[ballID].pos.X != 1000000 && cur.balls[ballID].inPocket == -1;
+}
+
+//A ball sitting still on the table. It can't run into anything itself, so only moving balls look for
+//collisions with it, and it wakes up when one of them hits it
+inline bool asleep(const state &cur, int ballID) {
+  return onTable(cur, ballID) && cur.balls[ballID].vel == vector();
+}
+
+//Instrumentation, only built in with -DPOOL_TRACE: counts of what the engine did and its last TRACE_CAPACITY
+//events, kept per thread so nothing is shared. Without it the TRACE_ macros are empty and it costs nothing
+#ifdef POOL_TRACE
+#ifndef TRACE_CAPACITY
+#define TRACE_CAPACITY 4096
+#endif
+
+struct traceEvent {
+  double time;
+  int type, i, j; // as in event, i = -1 for getGhostImage's imaginary cue ball
+};
+
+struct traceLog {
+  long pairTests;   // exact ball-ball predictions
+  long pairsPruned; // balls in neighbouring cells ruled out by the bounding test before that
+  long events[3];   // resolved, by type: balls, pocket, cushion
+  long steps, frames;
+  long written;     // events ever recorded, the last TRACE_CAPACITY of them are in ring
+  traceEvent ring[TRACE_CAPACITY];
+};
+
+inline traceLog &threadTrace() {
+  static thread_local traceLog log;
+  return log;
+}
+
+inline void traceRecord(double time, int type, int i, int j) {
+  traceLog &log = threadTrace();
+  traceEvent &e = log.ring[log.written++ % TRACE_CAPACITY];
+  e.time = time, e.type = type, e.i = i, e.j = j;
+}
+
+inline void resetTrace() {
+  memset(&threadTrace(), 0, sizeof(traceLog));
+}
+
+//Writes this thread's counts and the events still in its ring, oldest first
+inline void dumpTrace(FILE *out) {
+  traceLog &log = threadTrace();
+  fprintf(out, "pair tests %ld, pruned %ld, events %ld balls %ld pocket %ld cushion, steps %ld, frames %ld (%.2f steps per frame)\n",
+          log.pairTests, log.pairsPruned, log.events[0], log.events[1], log.events[2], log.steps, log.frames,
+          log.frames ? (double) log.steps / log.frames : 0.);
+  for(long k = std::max(0L, log.written - TRACE_CAPACITY); k < log.written; ++k) {
+    const traceEvent &e = log.ring[k % TRACE_CAPACITY];
+    fprintf(out, "%.6f type %d i %d j %d\n", e.time, e.type, e.i, e.j);
+  }
+}
+
+#define TRACE_COUNT(field, n) (threadTrace().field += (n))
+#define TRACE_EVENT(time, type, i, j) traceRecord(time, type, i, j)
+#else
+inline void resetTrace() {
+}
+
+inline void dumpTrace(FILE *out) {
+  fprintf(out, "tracing is off, build with -DPOOL_TRACE\n");
+}
+
+#define TRACE_COUNT(field, n)
+#define TRACE_EVENT(time, type, i, j)
+#endif
+
+//A predicted collision. Goes stale once either ball has collided with something since it was predicted
+struct event {
+  double time;
+  int type; // 0: balls, 1: pocket, 2: cushion
+  int i, j;
+  int countI, countJ;
+
+  //Reversed so that the heap hands out the earliest event first
+  bool operator<(const event &other) const {
+    return time > other.time;
+  }
+};
+
+//Balls laid out field by field, so one ball can be tested against many of them at once
+//decelX/decelY hold ball::decel(), reach is how close a ball has to get to touch each one
+//Scalar is what the fields are stored as. The simulation keeps its balls in double, a float copy only ever
+//decides which pairs are worth the exact test
+template <class Scalar>
+struct basicBallArrays {
+  int n;
+  std::vector<Scalar> x, y, vx, vy, decelX, decelY, reach;
+  std::vector<Scalar> alive; // 1 if on the table, 0 if not
+  std::vector<int> id;       // which ball of the state sits in each slot
+
+  void resize(int size) {
+    n = size;
+    x.assign(n, 0), y.assign(n, 0), vx.assign(n, 0), vy.assign(n, 0);
+    decelX.assign(n, 0), decelY.assign(n, 0), reach.assign(n, 0), alive.assign(n, 0);
+    id.assign(n, -1);
+  }
+
+  void store(int k, const ball &b) {
+    x[k] = b.pos.X, y[k] = b.pos.Y;
+    vx[k] = b.vel.X, vy[k] = b.vel.Y;
+    decelX[k] = b.decel().X, decelY[k] = b.decel().Y;
+  }
+
+  void load(int k, ball &b) const {
+    b.pos = vector(x[k], y[k]);
+    b.vel = vector(vx[k], vy[k]);
+  }
+
+  //Slot k of from, rounded to Scalar
+  template <class Other>
+  void copy(int k, const basicBallArrays<Other> &from) {
+    x[k] = from.x[k], y[k] = from.y[k], vx[k] = from.vx[k], vy[k] = from.vy[k];
+    decelX[k] = from.decelX[k], decelY[k] = from.decelY[k], reach[k] = from.reach[k], alive[k] = from.alive[k];
+    id[k] = from.id[k];
+  }
+
+  //Just where slot k of from is and how fast it's going, which is all advance changes that nearby reads
+  template <class Other>
+  void copyMotion(int k, const basicBallArrays<Other> &from) {
+    x[k] = from.x[k], y[k] = from.y[k], vx[k] = from.vx[k], vy[k] = from.vy[k];
+  }
+};
+
+typedef basicBallArrays<double> ballArrays;
+
+//Cushions laid out field by field like ballArrays, so a ball can be swept against all of them at once
+//Each runs len from (x1, y1) to (x2, y2) along the unit vector (ux, uy), with the table on the side of the unit
+//normal (nx, ny). res is how much of a ball's speed into the cushion comes back out of it
+template <class Scalar>
+struct basicSegmentArrays {
+  int n;
+  std::vector<Scalar> x1, y1, x2, y2, ux, uy, nx, ny, len, res;
+
+  void clear() {
+    n = 0;
+    x1.clear(), y1.clear(), x2.clear(), y2.clear(), ux.clear(), uy.clear();
+    nx.clear(), ny.clear(), len.clear(), res.clear();
+  }
+
+  void add(const cushionSpec &c, double restitution) {
+    double dx = c.x2 - c.x1, dy = c.y2 - c.y1, l = sqrt(dx * dx + dy * dy);
+    x1.push_back(c.x1), y1.push_back(c.y1), x2.push_back(c.x2), y2.push_back(c.y2);
+    ux.push_back(dx / l), uy.push_back(dy / l), nx.push_back(-dy / l), ny.push_back(dx / l);
+    len.push_back(l), res.push_back(restitution);
+    ++n;
+  }
+};
+
+typedef basicSegmentArrays<double> segmentArrays;
+
+//How far off a kernel's lengths can be from rounding, per metre of the lengths that go into them. None in double,
+//which the exact tests round the same way. In float it's a few dozen roundings' worth, and the kernels pad
+//what they let through by it so they still never rule out anything double wouldn't
+template <class Scalar>
+Scalar roundingSlack() {
+  return 64 * std::numeric_limits<Scalar>::epsilon();
+}
+
+template <>
+inline double roundingSlack<double>() {
+  return 0;
+}
+
+//Whether ball a could come within reach of slot k before horizon: both are treated as moving in straight
+//lines, with room for friction to pull each off its line by at most FRICTION/2 s^2
+template <class Scalar>
+bool mayTouch(const basicBallArrays<Scalar> &b, int k, const ball &a, double horizon) {
+  Scalar dx = (Scalar) a.pos.X - b.x[k], dy = (Scalar) a.pos.Y - b.y[k];
+  Scalar dvx = (Scalar) a.vel.X - b.vx[k], dvy = (Scalar) a.vel.Y - b.vy[k];
+  Scalar vv = dvx * dvx + dvy * dvy, h = horizon;
+  Scalar s = -(dx * dvx + dy * dvy) / (vv > std::numeric_limits<Scalar>::min() ? vv : std::numeric_limits<Scalar>::min());
+  s = s < 0 ? 0 : (s > h ? h : s);
+  Scalar cx = dx + dvx * s, cy = dy + dvy * s;
+  Scalar lim = b.reach[k] + (Scalar) (FRICTION * horizon * horizon);
+  if (roundingSlack<Scalar>() > 0) {
+    lim += roundingSlack<Scalar>() * (std::fabs(b.x[k]) + std::fabs(b.y[k]) + (Scalar) (std::fabs(a.pos.X) + std::fabs(a.pos.Y)) +
+                                      (std::fabs(dvx) + std::fabs(dvy)) * h + lim);
+  }
+  return b.alive[k] > 0 && cx * cx + cy * cy < lim * lim;
+}
+
+//nearby's SIMD part: tests slots from k on, as many lanes at a time as fit before end, and returns the first
+//slot it didn't get to. Anything without lanes of its own is left to mayTouch
+template <class Scalar>
+int nearbyLanes(const basicBallArrays<Scalar> &, int k, int, const ball &, double, int *, int &) {
+  return k;
+}
+
+#if defined(__AVX__) || defined(__SSE2__)
+inline int nearbyLanes(const ballArrays &b, int k, int end, const ball &a, double horizon, int *out, int &found) {
+#if defined(__AVX__)
+  __m256d px = _mm256_set1_pd(a.pos.X), py = _mm256_set1_pd(a.pos.Y);
+  __m256d pvx = _mm256_set1_pd(a.vel.X), pvy = _mm256_set1_pd(a.vel.Y);
+  __m256d zero = _mm256_setzero_pd(), tiny = _mm256_set1_pd(1e-300), h = _mm256_set1_pd(horizon);
+  __m256d slack = _mm256_set1_pd(FRICTION * horizon * horizon);
+  for(; k + 4 <= end; k += 4) {
+    __m256d dx = _mm256_sub_pd(px, _mm256_loadu_pd(&b.x[k])), dy = _mm256_sub_pd(py, _mm256_loadu_pd(&b.y[k]));
+    __m256d dvx = _mm256_sub_pd(pvx, _mm256_loadu_pd(&b.vx[k])), dvy = _mm256_sub_pd(pvy, _mm256_loadu_pd(&b.vy[k]));
+    __m256d vv = _mm256_add_pd(_mm256_mul_pd(dvx, dvx), _mm256_mul_pd(dvy, dvy));
+    __m256d dot = _mm256_add_pd(_mm256_mul_pd(dx, dvx), _mm256_mul_pd(dy, dvy));
+    __m256d s = _mm256_div_pd(_mm256_sub_pd(zero, dot), _mm256_max_pd(vv, tiny));
+    s = _mm256_min_pd(_mm256_max_pd(s, zero), h);
+    __m256d cx = _mm256_add_pd(dx, _mm256_mul_pd(dvx, s)), cy = _mm256_add_pd(dy, _mm256_mul_pd(dvy, s));
+    __m256d dist = _mm256_add_pd(_mm256_mul_pd(cx, cx), _mm256_mul_pd(cy, cy));
+    __m256d lim = _mm256_add_pd(_mm256_loadu_pd(&b.reach[k]), slack);
+    __m256d hit = _mm256_and_pd(_mm256_cmp_pd(dist, _mm256_mul_pd(lim, lim), _CMP_LT_OQ),
+                                _mm256_cmp_pd(_mm256_loadu_pd(&b.alive[k]), zero, _CMP_GT_OQ));
+    for(int mask = _mm256_movemask_pd(hit); mask; mask &= mask - 1) {
+      out[found++] = k + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__SSE2__)
+  __m128d px = _mm_set1_pd(a.pos.X), py = _mm_set1_pd(a.pos.Y);
+  __m128d pvx = _mm_set1_pd(a.vel.X), pvy = _mm_set1_pd(a.vel.Y);
+  __m128d zero = _mm_setzero_pd(), tiny = _mm_set1_pd(1e-300), h = _mm_set1_pd(horizon);
+  __m128d slack = _mm_set1_pd(FRICTION * horizon * horizon);
+  for(; k + 2 <= end; k += 2) {
+    __m128d dx = _mm_sub_pd(px, _mm_loadu_pd(&b.x[k])), dy = _mm_sub_pd(py, _mm_loadu_pd(&b.y[k]));
+    __m128d dvx = _mm_sub_pd(pvx, _mm_loadu_pd(&b.vx[k])), dvy = _mm_sub_pd(pvy, _mm_loadu_pd(&b.vy[k]));
+    __m128d vv = _mm_add_pd(_mm_mul_pd(dvx, dvx), _mm_mul_pd(dvy, dvy));
+    __m128d dot = _mm_add_pd(_mm_mul_pd(dx, dvx), _mm_mul_pd(dy, dvy));
+    __m128d s = _mm_div_pd(_mm_sub_pd(zero, dot), _mm_max_pd(vv, tiny));
+    s = _mm_min_pd(_mm_max_pd(s, zero), h);
+    __m128d cx = _mm_add_pd(dx, _mm_mul_pd(dvx, s)), cy = _mm_add_pd(dy, _mm_mul_pd(dvy, s));
+    __m128d dist = _mm_add_pd(_mm_mul_pd(cx, cx), _mm_mul_pd(cy, cy));
+    __m128d lim = _mm_add_pd(_mm_loadu_pd(&b.reach[k]), slack);
+    __m128d hit = _mm_and_pd(_mm_cmplt_pd(dist, _mm_mul_pd(lim, lim)), _mm_cmpgt_pd(_mm_loadu_pd(&b.alive[k]), zero));
+    for(int mask = _mm_movemask_pd(hit); mask; mask &= mask - 1) {
+      out[found++] = k + __builtin_ctz(mask);
+    }
+  }
+#endif
+  return k;
+}
+
+//Twice the lanes of the double version, with mayTouch's padding for rounding. With AVX the last few slots go
+//through the lanes too, masked off past end, since a grid's runs are mostly shorter than eight
+inline int nearbyLanes(const basicBallArrays<float> &b, int k, int end, const ball &a, double horizon, int *out, int &found) {
+#if defined(__AVX__)
+  __m256 px = _mm256_set1_ps(a.pos.X), py = _mm256_set1_ps(a.pos.Y);
+  __m256 pvx = _mm256_set1_ps(a.vel.X), pvy = _mm256_set1_ps(a.vel.Y);
+  __m256 zero = _mm256_setzero_ps(), tiny = _mm256_set1_ps(std::numeric_limits<float>::min()), h = _mm256_set1_ps(horizon);
+  __m256 slack = _mm256_set1_ps(FRICTION * horizon * horizon), pad = _mm256_set1_ps(roundingSlack<float>());
+  __m256 sign = _mm256_set1_ps(-0.f), span = _mm256_set1_ps(fabs(a.pos.X) + fabs(a.pos.Y));
+  __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  for(; k < end; k += 8) {
+    //Lanes past end load as 0, which leaves them not alive
+    __m256i live = _mm256_castps_si256(_mm256_cmp_ps(lane, _mm256_set1_ps(end - k), _CMP_LT_OQ));
+    __m256 bx = _mm256_maskload_ps(&b.x[k], live), by = _mm256_maskload_ps(&b.y[k], live);
+    __m256 dx = _mm256_sub_ps(px, bx), dy = _mm256_sub_ps(py, by);
+    __m256 dvx = _mm256_sub_ps(pvx, _mm256_maskload_ps(&b.vx[k], live)), dvy = _mm256_sub_ps(pvy, _mm256_maskload_ps(&b.vy[k], live));
+    __m256 vv = _mm256_add_ps(_mm256_mul_ps(dvx, dvx), _mm256_mul_ps(dvy, dvy));
+    __m256 dot = _mm256_add_ps(_mm256_mul_ps(dx, dvx), _mm256_mul_ps(dy, dvy));
+    __m256 s = _mm256_div_ps(_mm256_sub_ps(zero, dot), _mm256_max_ps(vv, tiny));
+    s = _mm256_min_ps(_mm256_max_ps(s, zero), h);
+    __m256 cx = _mm256_add_ps(dx, _mm256_mul_ps(dvx, s)), cy = _mm256_add_ps(dy, _mm256_mul_ps(dvy, s));
+    __m256 dist = _mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy));
+    __m256 lim = _mm256_add_ps(_mm256_maskload_ps(&b.reach[k], live), slack);
+    __m256 size = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(sign, bx), _mm256_andnot_ps(sign, by)), _mm256_add_ps(span, lim));
+    size = _mm256_add_ps(size, _mm256_mul_ps(_mm256_add_ps(_mm256_andnot_ps(sign, dvx), _mm256_andnot_ps(sign, dvy)), h));
+    lim = _mm256_add_ps(lim, _mm256_mul_ps(pad, size));
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(dist, _mm256_mul_ps(lim, lim), _CMP_LT_OQ),
+                               _mm256_cmp_ps(_mm256_maskload_ps(&b.alive[k], live), zero, _CMP_GT_OQ));
+    for(int mask = _mm256_movemask_ps(hit); mask; mask &= mask - 1) {
+      out[found++] = k + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__SSE2__)
+  __m128 px = _mm_set1_ps(a.pos.X), py = _mm_set1_ps(a.pos.Y);
+  __m128 pvx = _mm_set1_ps(a.vel.X), pvy = _mm_set1_ps(a.vel.Y);
+  __m128 zero = _mm_setzero_ps(), tiny = _mm_set1_ps(std::numeric_limits<float>::min()), h = _mm_set1_ps(horizon);
+  __m128 slack = _mm_set1_ps(FRICTION * horizon * horizon), pad = _mm_set1_ps(roundingSlack<float>());
+  __m128 sign = _mm_set1_ps(-0.f), span = _mm_set1_ps(fabs(a.pos.X) + fabs(a.pos.Y));
+  for(; k + 4 <= end; k += 4) {
+    __m128 bx = _mm_loadu_ps(&b.x[k]), by = _mm_loadu_ps(&b.y[k]);
+    __m128 dx = _mm_sub_ps(px, bx), dy = _mm_sub_ps(py, by);
+    __m128 dvx = _mm_sub_ps(pvx, _mm_loadu_ps(&b.vx[k])), dvy = _mm_sub_ps(pvy, _mm_loadu_ps(&b.vy[k]));
+    __m128 vv = _mm_add_ps(_mm_mul_ps(dvx, dvx), _mm_mul_ps(dvy, dvy));
+    __m128 dot = _mm_add_ps(_mm_mul_ps(dx, dvx), _mm_mul_ps(dy, dvy));
+    __m128 s = _mm_div_ps(_mm_sub_ps(zero, dot), _mm_max_ps(vv, tiny));
+    s = _mm_min_ps(_mm_max_ps(s, zero), h);
+    __m128 cx = _mm_add_ps(dx, _mm_mul_ps(dvx, s)), cy = _mm_add_ps(dy, _mm_mul_ps(dvy, s));
+    __m128 dist = _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy));
+    __m128 lim = _mm_add_ps(_mm_loadu_ps(&b.reach[k]), slack);
+    __m128 size = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign, bx), _mm_andnot_ps(sign, by)), _mm_add_ps(span, lim));
+    size = _mm_add_ps(size, _mm_mul_ps(_mm_add_ps(_mm_andnot_ps(sign, dvx), _mm_andnot_ps(sign, dvy)), h));
+    lim = _mm_add_ps(lim, _mm_mul_ps(pad, size));
+    __m128 hit = _mm_and_ps(_mm_cmplt_ps(dist, _mm_mul_ps(lim, lim)), _mm_cmpgt_ps(_mm_loadu_ps(&b.alive[k]), zero));
+    for(int mask = _mm_movemask_ps(hit); mask; mask &= mask - 1) {
+      out[found++] = k + __builtin_ctz(mask);
+    }
+  }
+#endif
+  return k;
+}
+#endif
+
+//Pairwise kernel: writes out the slots in [begin, end) that ball a could touch before horizon, returns how many
+//Only those need the exact (and much slower) time of impact from collideHelper, which is always in double
+template <class Scalar>
+int nearby(const basicBallArrays<Scalar> &b, int begin, int end, const ball &a, double horizon, int *out) {
+  int found = 0, k = nearbyLanes(b, begin, end, a, horizon, out, found);
+  for(; k < end; ++k) {
+    if (mayTouch(b, k, a, horizon)) {
+      out[found++] = k;
+    }
+  }
+  return found;
+}
+
+//Returns at what time the ball colliddes with the pocket (ie gets sunk)
+//pockets holds each pocket's center and how close a ball's center has to get to it
+inline double collidePocket(ball cur, const ballArrays &pockets, int pockID, double dt) {
+  return collideHelper(cur, ball(vector(pockets.x[pockID], pockets.y[pockID]), pockID), dt, pockets.reach[pockID]);
+}
+
+//How far a center at (px, py) heading along (wx, wy) goes, up to far, before it comes within radius of the
+//cushion end (ex, ey), or HUGE_VAL. Touching it already only counts if still heading in
+//pad widens the test by that much, for a float filter that mustn't miss what double would find
+template <class Scalar>
+Scalar capDistance(Scalar px, Scalar py, Scalar wx, Scalar wy, Scalar ex, Scalar ey, Scalar radius, Scalar far, Scalar pad = 0) {
+  Scalar qx = px - ex, qy = py - ey;
+  Scalar b = wx * qx + wy * qy, c = qx * qx + qy * qy - (radius + pad) * (radius + pad);
+  Scalar d = HUGE_VAL;
+  if (c <= 0) {
+    d = b < pad ? 0 : HUGE_VAL;
+  } else if (b < pad && b * b >= c) {
+    d = -b - sqrt(b * b - c);
+  }
+  return d <= far + pad ? d : HUGE_VAL;
+}
+
+//Swept circle against cushion k: how far a ball's center goes from (px, py) along (wx, wy), up to far, before
+//its edge first touches the cushion's face from the table side or either of its ends. HUGE_VAL if it doesn't
+//slack and pad are roundingSlack and the lengths it's padded by, for the float filter
+template <class Scalar>
+Scalar cushionDistance(const basicSegmentArrays<Scalar> &s, int k, Scalar px, Scalar py, Scalar wx, Scalar wy, Scalar radius, Scalar far,
+                       Scalar slack = 0, Scalar pad = 0) {
+  Scalar dx = px - s.x1[k], dy = py - s.y1[k];
+  Scalar h0 = s.nx[k] * dx + s.ny[k] * dy - radius, hw = s.nx[k] * wx + s.ny[k] * wy;
+  Scalar d = HUGE_VAL;
+  if (hw < slack && h0 > -radius - pad) {
+    //Heading in at a shallow angle, rounding moves where along the face it lands by a lot more than pad
+    Scalar face = h0 > pad ? (h0 - pad) / std::max(-hw, std::numeric_limits<Scalar>::min()) : 0;
+    Scalar f = s.ux[k] * (dx + wx * face) + s.uy[k] * (dy + wy * face);
+    Scalar slop = pad + face * slack / std::max(-hw, slack);
+    if (face <= far + pad && f >= -slop && f <= s.len[k] + slop) {
+      d = face;
+    }
+  }
+  d = std::min(d, capDistance(px, py, wx, wy, s.x1[k], s.y1[k], radius, far, pad));
+  return std::min(d, capDistance(px, py, wx, wy, s.x2[k], s.y2[k], radius, far, pad));
+}
+
+#if defined(__AVX__)
+//capDistance for four cushion ends at once
+inline __m256d capDistance4(__m256d px, __m256d py, __m256d wx, __m256d wy, __m256d ex, __m256d ey, __m256d radius, __m256d far) {
+  __m256d zero = _mm256_setzero_pd(), inf = _mm256_set1_pd(HUGE_VAL);
+  __m256d qx = _mm256_sub_pd(px, ex), qy = _mm256_sub_pd(py, ey);
+  __m256d b = _mm256_add_pd(_mm256_mul_pd(wx, qx), _mm256_mul_pd(wy, qy));
+  __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(qx, qx), _mm256_mul_pd(qy, qy)), _mm256_mul_pd(radius, radius));
+  __m256d disc = _mm256_sub_pd(_mm256_mul_pd(b, b), c);
+  __m256d heading = _mm256_cmp_pd(b, zero, _CMP_LT_OQ);
+  __m256d hit = _mm256_sub_pd(_mm256_sub_pd(zero, b), _mm256_sqrt_pd(_mm256_max_pd(disc, zero)));
+  __m256d outside = _mm256_blendv_pd(inf, hit, _mm256_and_pd(heading, _mm256_cmp_pd(disc, zero, _CMP_GE_OQ)));
+  __m256d d = _mm256_blendv_pd(outside, _mm256_blendv_pd(inf, zero, heading), _mm256_cmp_pd(c, zero, _CMP_LE_OQ));
+  return _mm256_blendv_pd(inf, d, _mm256_cmp_pd(d, far, _CMP_LE_OQ));
+}
+
+//capDistance for eight cushion ends at once, radius and far already padded
+inline __m256 capDistance8(__m256 px, __m256 py, __m256 wx, __m256 wy, __m256 ex, __m256 ey, __m256 radius, __m256 far, __m256 pad) {
+  __m256 zero = _mm256_setzero_ps(), inf = _mm256_set1_ps(HUGE_VAL);
+  __m256 qx = _mm256_sub_ps(px, ex), qy = _mm256_sub_ps(py, ey);
+  __m256 b = _mm256_add_ps(_mm256_mul_ps(wx, qx), _mm256_mul_ps(wy, qy));
+  __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(qx, qx), _mm256_mul_ps(qy, qy)), _mm256_mul_ps(radius, radius));
+  __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), c);
+  __m256 heading = _mm256_cmp_ps(b, pad, _CMP_LT_OQ);
+  __m256 hit = _mm256_sub_ps(_mm256_sub_ps(zero, b), _mm256_sqrt_ps(_mm256_max_ps(disc, zero)));
+  __m256 outside = _mm256_blendv_ps(inf, hit, _mm256_and_ps(heading, _mm256_cmp_ps(disc, zero, _CMP_GE_OQ)));
+  __m256 d = _mm256_blendv_ps(outside, _mm256_blendv_ps(inf, zero, heading), _mm256_cmp_ps(c, zero, _CMP_LE_OQ));
+  return _mm256_blendv_ps(inf, d, _mm256_cmp_ps(d, far, _CMP_LE_OQ));
+}
+#endif
+
+//cushionContacts' SIMD part: writes the distance to each cushion from k on, as many lanes at a time as fit before
+//end, and returns the first cushion it didn't get to
+template <class Scalar>
+int cushionLanes(const basicSegmentArrays<Scalar> &, int k, int, const ball &, double, double, double, double, double, double *) {
+  return k;
+}
+
+#if defined(__AVX__)
+inline int cushionLanes(const segmentArrays &s, int k, int end, const ball &a, double wx, double wy, double radius, double far, double,
+                        double *times) {
+  __m256d px = _mm256_set1_pd(a.pos.X), py = _mm256_set1_pd(a.pos.Y);
+  __m256d pwx = _mm256_set1_pd(wx), pwy = _mm256_set1_pd(wy);
+  __m256d r = _mm256_set1_pd(radius), negR = _mm256_set1_pd(-radius), pfar = _mm256_set1_pd(far);
+  __m256d zero = _mm256_setzero_pd(), inf = _mm256_set1_pd(HUGE_VAL);
+  for(; k + 4 <= end; k += 4) {
+    __m256d x1 = _mm256_loadu_pd(&s.x1[k]), y1 = _mm256_loadu_pd(&s.y1[k]);
+    __m256d nx = _mm256_loadu_pd(&s.nx[k]), ny = _mm256_loadu_pd(&s.ny[k]);
+    __m256d dx = _mm256_sub_pd(px, x1), dy = _mm256_sub_pd(py, y1);
+    __m256d h0 = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(nx, dx), _mm256_mul_pd(ny, dy)), r);
+    __m256d hw = _mm256_add_pd(_mm256_mul_pd(nx, pwx), _mm256_mul_pd(ny, pwy));
+    __m256d face = _mm256_div_pd(_mm256_max_pd(h0, zero), _mm256_sub_pd(zero, hw));
+    __m256d f = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(&s.ux[k]), _mm256_add_pd(dx, _mm256_mul_pd(pwx, face))),
+                              _mm256_mul_pd(_mm256_loadu_pd(&s.uy[k]), _mm256_add_pd(dy, _mm256_mul_pd(pwy, face))));
+    __m256d ok = _mm256_and_pd(_mm256_cmp_pd(hw, zero, _CMP_LT_OQ), _mm256_cmp_pd(h0, negR, _CMP_GT_OQ));
+    ok = _mm256_and_pd(ok, _mm256_cmp_pd(face, pfar, _CMP_LE_OQ));
+    ok = _mm256_and_pd(ok, _mm256_and_pd(_mm256_cmp_pd(f, zero, _CMP_GE_OQ), _mm256_cmp_pd(f, _mm256_loadu_pd(&s.len[k]), _CMP_LE_OQ)));
+    __m256d d = _mm256_blendv_pd(inf, face, ok);
+    d = _mm256_min_pd(d, capDistance4(px, py, pwx, pwy, x1, y1, r, pfar));
+    d = _mm256_min_pd(d, capDistance4(px, py, pwx, pwy, _mm256_loadu_pd(&s.x2[k]), _mm256_loadu_pd(&s.y2[k]), r, pfar));
+    _mm256_storeu_pd(&times[k], d);
+  }
+  return k;
+}
+
+//Twice the lanes, padded the same way as cushionDistance
+inline int cushionLanes(const basicSegmentArrays<float> &s, int k, int end, const ball &a, double wx, double wy, double radius, double far,
+                        double pad, double *times) {
+  __m256 px = _mm256_set1_ps(a.pos.X), py = _mm256_set1_ps(a.pos.Y);
+  __m256 pwx = _mm256_set1_ps(wx), pwy = _mm256_set1_ps(wy);
+  __m256 r = _mm256_set1_ps(radius), wide = _mm256_set1_ps(radius + pad), low = _mm256_set1_ps(-radius - pad);
+  __m256 p = _mm256_set1_ps(pad), slack = _mm256_set1_ps(roundingSlack<float>());
+  __m256 pfar = _mm256_set1_ps(far + pad), tiny = _mm256_set1_ps(std::numeric_limits<float>::min());
+  __m256 zero = _mm256_setzero_ps(), inf = _mm256_set1_ps(HUGE_VAL);
+  for(; k + 8 <= end; k += 8) {
+    __m256 x1 = _mm256_loadu_ps(&s.x1[k]), y1 = _mm256_loadu_ps(&s.y1[k]);
+    __m256 nx = _mm256_loadu_ps(&s.nx[k]), ny = _mm256_loadu_ps(&s.ny[k]);
+    __m256 dx = _mm256_sub_ps(px, x1), dy = _mm256_sub_ps(py, y1);
+    __m256 h0 = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(nx, dx), _mm256_mul_ps(ny, dy)), r);
+    __m256 hw = _mm256_add_ps(_mm256_mul_ps(nx, pwx), _mm256_mul_ps(ny, pwy));
+    __m256 in = _mm256_sub_ps(zero, hw);
+    __m256 face = _mm256_div_ps(_mm256_max_ps(_mm256_sub_ps(h0, p), zero), _mm256_max_ps(in, tiny));
+    __m256 f = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&s.ux[k]), _mm256_add_ps(dx, _mm256_mul_ps(pwx, face))),
+                             _mm256_mul_ps(_mm256_loadu_ps(&s.uy[k]), _mm256_add_ps(dy, _mm256_mul_ps(pwy, face))));
+    __m256 slop = _mm256_add_ps(p, _mm256_div_ps(_mm256_mul_ps(face, slack), _mm256_max_ps(in, slack)));
+    __m256 ok = _mm256_and_ps(_mm256_cmp_ps(hw, slack, _CMP_LT_OQ), _mm256_cmp_ps(h0, low, _CMP_GT_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(face, pfar, _CMP_LE_OQ));
+    ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(_mm256_add_ps(f, slop), zero, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(_mm256_sub_ps(f, slop), _mm256_loadu_ps(&s.len[k]), _CMP_LE_OQ)));
+    __m256 d = _mm256_blendv_ps(inf, face, ok);
+    d = _mm256_min_ps(d, capDistance8(px, py, pwx, pwy, x1, y1, wide, pfar, p));
+    d = _mm256_min_ps(d, capDistance8(px, py, pwx, pwy, _mm256_loadu_ps(&s.x2[k]), _mm256_loadu_ps(&s.y2[k]), wide, pfar, p));
+    _mm256_storeu_pd(&times[k], _mm256_cvtps_pd(_mm256_castps256_ps128(d)));
+    _mm256_storeu_pd(&times[k + 4], _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1)));
+  }
+  return k;
+}
+#endif
+
+//Cushion kernel: the time ball a first touches each cushion, -1 for the ones it doesn't reach before horizon
+//Friction only slows a ball down, so until it hits something it rolls along a straight line. That makes each
+//cushion a swept circle against a segment: a distance along the line in closed form, then when it gets that far
+//s is the cushions in the kernel's Scalar and exact the same ones in double. In double they're one and the
+//same, in float s only picks out the cushions in reach and their distances are worked out again from exact
+template <class Scalar>
+void cushionContacts(const basicSegmentArrays<Scalar> &s, const segmentArrays &exact, const ball &a, double radius, double horizon,
+                     double *times) {
+  double speed = abs(a.vel);
+  if (speed == 0) {
+    std::fill(times, times + s.n, -1.0);
+    return;
+  }
+  double wx = a.vel.X / speed, wy = a.vel.Y / speed;
+  double t = min(horizon, a.stopTime());
+  double far = speed * t - FRICTION / 2 * t * t;
+  double slack = roundingSlack<Scalar>(), pad = slack * (2 * (fabs(a.pos.X) + fabs(a.pos.Y)) + far + radius);
+  int k = cushionLanes(s, 0, s.n, a, wx, wy, radius, far, pad, times);
+  for(; k < s.n; ++k) {
+    times[k] = cushionDistance<Scalar>(s, k, a.pos.X, a.pos.Y, wx, wy, radius, far, slack, pad);
+  }
+  //The ones in reach are worked out again in double, in the same blocks of four double would have used, so that
+  //they come out exactly the same even where the compiler fuses multiplies and adds outside the lanes
+  for(k = 0; slack > 0 && k < s.n; k += 4) {
+    int end = std::min(k + 4, s.n), j = k;
+    while (j < end && times[j] == HUGE_VAL) {
+      ++j;
+    }
+    if (j == end) continue;
+    for(j = cushionLanes(exact, k, end, a, wx, wy, radius, far, 0, times); j < end; ++j) {
+      times[j] = cushionDistance<double>(exact, j, a.pos.X, a.pos.Y, wx, wy, radius, far);
+    }
+  }
+  //Distance to time: speed * t - FRICTION / 2 * t^2 = d, solved in the form that doesn't cancel
+  for(k = 0; k < s.n; ++k) {
+    double d = times[k];
+    times[k] = d == HUGE_VAL ? -1 : 2 * d / (speed + sqrt(std::max(speed * speed - 2 * FRICTION * d, 0.0)));
+  }
+}
+
+inline void cushionContacts(const segmentArrays &s, const ball &a, double radius, double horizon, double *times) {
+  cushionContacts(s, s, a, radius, horizon, times);
+}
+
+//Adjusts velocities when a ball hits cushion k: it bounces straight off the face, or off the end if that's what
+//it caught, keeping res of its speed into the cushion
+inline void handleCollideCushion(ball &a, const segmentArrays &s, int k) {
+  double f = (a.pos.X - s.x1[k]) * s.ux[k] + (a.pos.Y - s.y1[k]) * s.uy[k];
+  f = f < 0 ? 0 : (f > s.len[k] ? s.len[k] : f);
+  vector normal = a.pos - vector(s.x1[k] + f * s.ux[k], s.y1[k] + f * s.uy[k]);
+  normal = abs(normal) > 0 ? normal / abs(normal) : vector(s.nx[k], s.ny[k]);
+  double in = dot(a.vel, normal);
+  if (in < 0) {
+    a.vel -= (1 + s.res[k]) * in * normal;
+  }
+}
+
+//A table's cushions and pockets, the way the simulation goes through them. A pocket's reach is how close a
+//ball's center has to get to drop in
+//roundedCushions are the same cushions in float, for floatSimulation's cushion kernel
+struct tableOutline {
+  segmentArrays cushions;
+  basicSegmentArrays<float> roundedCushions;
+  ballArrays pockets;
+
+  tableOutline() {
+    clear();
+  }
+
+  void clear() {
+    cushions.clear();
+    roundedCushions.clear();
+    pockets.resize(0);
+  }
+};
+
+inline void addCushion(tableOutline &out, const cushionSpec &c, double restitution) {
+  out.cushions.add(c, restitution);
+  out.roundedCushions.add(c, restitution);
+}
+
+//Adds a pocket of the given radius, which a ball of ballRadius drops into once its center is far enough over
+inline void addPocket(tableOutline &out, double x, double y, double radius, double ballRadius) {
+  ballArrays &p = out.pockets;
+  p.x.push_back(x), p.y.push_back(y), p.vx.push_back(0), p.vy.push_back(0);
+  p.decelX.push_back(0), p.decelY.push_back(0), p.alive.push_back(1), p.id.push_back(p.n);
+  p.reach.push_back(sqrt(4 * ballRadius * (radius - ballRadius)));
+  ++p.n;
+}
+
+template <class Spec>
+tableOutline buildOutline() {
+  tableOutline out;
+  for(int j = 0; j < 18; ++j) {
+    addCushion(out, Spec::CUSHIONS[j], RAIL_RES);
+  }
+  for(int j = 0; j < 6; ++j) {
+    addPocket(out, Spec::POCKETS[j].x, Spec::POCKETS[j].y, Spec::POCKETS[j].radius, Spec::BALL_RADIUS);
+  }
+  return out;
+}
+
+//The outline of one of the tableSpecs, built the first time it's asked for
+template <class Spec>
+const tableOutline &specOutline() {
+  static const tableOutline outline = buildOutline<Spec>();
+  return outline;
+}
+
+//Reads a table's outline from a text file, for tables that aren't one of the presets. One thing a line:
+//    cushion x1 y1 x2 y2 [res]   table on the side of (y1 - y2, x2 - x1), res is RAIL_RES if left out
+//    pocket x y radius
+//Blank lines and lines starting with # are skipped. Returns false if the file can't be read or has a bad line
+inline bool loadOutline(const char *path, double ballRadius, tableOutline &out) {
+  FILE *in = fopen(path, "r");
+  if (!in) {
+    return false;
+  }
+  out.clear();
+  bool ok = true;
+  char line[256], kind[16];
+  while (ok && fgets(line, sizeof line, in)) {
+    double v[5];
+    if (sscanf(line, " %15s", kind) != 1 || kind[0] == '#') {
+      continue;
+    }
+    if (!strcmp(kind, "cushion")) {
+      int n = sscanf(line, " %*s %lf %lf %lf %lf %lf", &v[0], &v[1], &v[2], &v[3], &v[4]);
+      ok = n >= 4 && (v[0] != v[2] || v[1] != v[3]);
+      if (ok) {
+        cushionSpec c = {v[0], v[1], v[2], v[3]};
+        addCushion(out, c, n == 5 ? v[4] : RAIL_RES);
+      }
+    } else if (!strcmp(kind, "pocket")) {
+      ok = sscanf(line, " %*s %lf %lf %lf", &v[0], &v[1], &v[2]) == 3 && v[2] > ballRadius;
+      if (ok) {
+        addPocket(out, v[0], v[1], v[2], ballRadius);
+      }
+    } else {
+      ok = false;
+    }
+  }
+  fclose(in);
+  return ok;
+}
+
+//Uniform grid over the table for finding the balls that could possibly touch within a step
+//A cell is as wide as two balls can close in on each other during the window, so only neighbouring cells matter
+//Balls are stored sorted by cell, so a cell and its left and right neighbours are one run of slots
+struct grid {
+  double cell;
+  int cols, rows;
+  std::vector<int> cellStart; // cell c holds slots cellStart[c] up to cellStart[c + 1]
+  std::vector<int> cellOf;    // which cell each ball binned into it went in, in the order they were given
+};
+
+//A state being simulated, plus every collision we've predicted from it
+//Kernel is the scalar type nearby and cushionContacts run in, double or float. Either way the balls and every
+//collision time stay in double, float only decides which pairs and cushions get the exact test, and twice as many
+//of those fit a vector
+template <class Kernel = double>
+struct basicSimulation {
+  state cur;
+  std::vector<ball> balls; // cur's balls, so the caller's state is left alone
+  std::vector<event> events; // heap, earliest on top
+  std::vector<int> counts; // how many collisions each ball has had
+  grid resting; // balls that were asleep, kept from window to window since they haven't moved
+  grid broad;   // the rest of the balls on the table, rebuilt every window
+  int still;    // resting's balls take the slots before this one, broad's the ones after
+  int stale;    // how many of resting's balls have been woken since it was built
+  double windowEnd; // ball-ball collisions are only predicted up to here, when broad gets rebuilt
+  double maxSpeed;  // fastest ball when the grid was built
+  double restTime;  // by when every ball will have stopped, unless something speeds one up
+  ballArrays arrays;  // the balls on the table, in grid order
+  std::vector<int> slot; // where each ball sits in arrays
+  std::vector<int> awake; // the slots of the balls moving when the grid was built, and of any hit since
+  std::vector<char> woken; // by slot, whether it's in awake
+  std::vector<int> binning; // balls on their way into a grid
+  const tableOutline *outline; // the cushions and pockets, if not the Spec's own
+  std::vector<int> scratch;
+  std::vector<int> cluster;  // balls in contact with the last pair of balls that collided
+  std::vector<int> contacts; // the pairs of them that touch, two entries per pair
+  std::vector<char> hit;     // which of cluster got their velocity changed
+  std::vector<double> cushionTimes;
+  event lastEvent; // what the last call to step handled, type -1 if no collision
+                   // for two balls, cluster and hit say which balls changed velocity along with them
+  std::vector<ball> frame; // balls of the last frame sampled
+  basicBallArrays<Kernel> rounded; // arrays rounded to Kernel, unless that's double. Last, so that in a
+                                   // double simulation, where it's never used, the rest sit where they always did
+
+  basicSimulation() : outline(NULL) {
+  }
+};
+
+//What floatSimulation prunes in: float with AVX's eight lanes, but without them four float lanes don't make up
+//for keeping the arrays rounded, so double. basicSimulation<float> is there either way
+#if defined(__AVX__)
+typedef float floatKernel;
+#else
+typedef double floatKernel;
+#endif
+
+typedef basicSimulation<double> simulation;
+typedef basicSimulation<floatKernel> floatSimulation;
+
+//The table sim runs on: the one set in sim.outline, or else Spec's
+template <class Spec, class Kernel>
+const tableOutline &outlineOf(const basicSimulation<Kernel> &sim) {
+  return sim.outline ? *sim.outline : specOutline<Spec>();
+}
+
+//The balls and cushions as the kernels read them: the double ones themselves, or the copies rounded to Kernel
+inline const ballArrays &kernelBalls(const simulation &sim) {
+  return sim.arrays;
+}
+
+template <class Kernel>
+const basicBallArrays<Kernel> &kernelBalls(const basicSimulation<Kernel> &sim) {
+  return sim.rounded;
+}
+
+inline const segmentArrays &kernelCushions(const simulation &, const tableOutline &table) {
+  return table.cushions;
+}
+
+template <class Kernel>
+const basicSegmentArrays<Kernel> &kernelCushions(const basicSimulation<Kernel> &, const tableOutline &table) {
+  return table.roundedCushions;
+}
+
+//Rounds slot k of the arrays into the copy the kernels read, when there is one
+inline void roundSlot(simulation &, int) {
+}
+
+template <class Kernel>
+void roundSlot(basicSimulation<Kernel> &sim, int k) {
+  sim.rounded.copy(k, sim.arrays);
+}
+
+//roundSlot for a ball that's only been advanced
+inline void roundMotion(simulation &, int) {
+}
+
+template <class Kernel>
+void roundMotion(basicSimulation<Kernel> &sim, int k) {
+  sim.rounded.copyMotion(k, sim.arrays);
+}
+
+inline void resizeRounded(simulation &, int) {
+}
+
+template <class Kernel>
+void resizeRounded(basicSimulation<Kernel> &sim, int size) {
+  sim.rounded.resize(size);
+}
+
+template <class Kernel>
+void addEvent(basicSimulation<Kernel> &sim, double t, int type, int i, int j) {
+  if (t == -1) {
+    return;
+  }
+  event e;
+  e.time = sim.cur.time + t;
+  e.type = type;
+  e.i = i;
+  e.j = j;
+  e.countI = sim.counts[i];
+  e.countJ = type == 0 ? sim.counts[j] : 0;
+  sim.events.push_back(e);
+  std::push_heap(sim.events.begin(), sim.events.end());
+}
+
+template <class Kernel>
+bool isValid(basicSimulation<Kernel> &sim, const event &e) {
+  if (e.countI != sim.counts[e.i]) return false;
+  return e.type != 0 || e.countJ == sim.counts[e.j];
+}
+
+//Bins the balls listed in sim.binning into g, in cells cell wide, and lays them out in the arrays cell by cell
+//starting from slot first
+template <class Spec, class Kernel>
+void binBalls(basicSimulation<Kernel> &sim, grid &g, double cell, int first) {
+  state &cur = sim.cur;
+  const std::vector<int> &ids = sim.binning;
+  g.cell = cell;
+  g.cols = (int) ceil(Spec::WIDTH / g.cell);
+  g.rows = (int) ceil(Spec::HEIGHT / g.cell);
+  if (g.cols < 1) g.cols = 1;
+  if (g.rows < 1) g.rows = 1;
+  g.cellStart.assign(g.cols * g.rows + 1, 0);
+  g.cellStart[0] = first;
+  g.cellOf.resize(ids.size());
+  for(size_t n = 0; n < ids.size(); ++n) {
+    int cx = (int) floor(cur.balls[ids[n]].pos.X / g.cell), cy = (int) floor(cur.balls[ids[n]].pos.Y / g.cell);
+    cx = cx < 0 ? 0 : (cx >= g.cols ? g.cols - 1 : cx);
+    cy = cy < 0 ? 0 : (cy >= g.rows ? g.rows - 1 : cy);
+    g.cellOf[n] = cy * g.cols + cx;
+    ++g.cellStart[g.cellOf[n] + 1];
+  }
+  for(int c = 0; c < g.cols * g.rows; ++c) {
+    g.cellStart[c + 1] += g.cellStart[c];
+  }
+
+  ballArrays &b = sim.arrays;
+  std::vector<int> &fill = sim.scratch;
+  fill.assign(g.cellStart.begin(), g.cellStart.end() - 1);
+  for(size_t n = 0; n < ids.size(); ++n) {
+    int k = fill[g.cellOf[n]]++;
+    b.store(k, cur.balls[ids[n]]);
+    b.reach[k] = 2 * Spec::BALL_RADIUS;
+    b.alive[k] = 1;
+    b.id[k] = ids[n];
+    sim.slot[ids[n]] = k;
+    roundSlot(sim, k);
+  }
+}
+
+//Writes out the runs of slots in the block of g's cells around p as begin, end pairs, one per row, and returns
+//how many rows there were
+inline int cellRuns(const grid &g, vector p, int *runs) {
+  int cx = (int) floor(p.X / g.cell), cy = (int) floor(p.Y / g.cell);
+  cx = cx < 0 ? 0 : (cx >= g.cols ? g.cols - 1 : cx);
+  cy = cy < 0 ? 0 : (cy >= g.rows ? g.rows - 1 : cy);
+  int left = cx > 0 ? cx - 1 : cx, right = cx + 1 < g.cols ? cx + 1 : cx;
+  int n = 0;
+  for(int y = cy - 1; y <= cy + 1; ++y) {
+    if (y < 0 || y >= g.rows) continue;
+    runs[2 * n] = g.cellStart[y * g.cols + left];
+    runs[2 * n + 1] = g.cellStart[y * g.cols + right + 1];
+    ++n;
+  }
+  return n;
+}
+
+//Predicts ball i's collisions with the balls numbered from firstBall on, and with any asleep ball, looking only in
+//the cells around it in both grids
+template <class Spec, class Kernel>
+void predictBalls(basicSimulation<Kernel> &sim, int i, int firstBall) {
+  state &cur = sim.cur;
+  if (!onTable(cur, i)) {
+    return;
+  }
+  double horizon = sim.windowEnd - cur.time;
+  sim.scratch.resize(sim.arrays.n);
+  int *near = sim.scratch.data();
+  int found = 0, runs[12];
+  int rows = cellRuns(sim.resting, cur.balls[i].pos, runs);
+  rows += cellRuns(sim.broad, cur.balls[i].pos, runs + 2 * rows);
+  for(int r = 0; r < rows; ++r) {
+    int hits = nearby(kernelBalls(sim), runs[2 * r], runs[2 * r + 1], cur.balls[i], horizon, near + found);
+    TRACE_COUNT(pairsPruned, runs[2 * r + 1] - runs[2 * r] - hits);
+    found += hits;
+  }
+  for(int k = 0; k < found; ++k) {
+    int j = sim.arrays.id[near[k]];
+    if (j != i && (j >= firstBall || asleep(cur, j))) {
+      TRACE_COUNT(pairTests, 1);
+      addEvent(sim, collideBalls<Spec>(cur.balls[i], cur.balls[j], horizon), 0, i, j);
+    }
+  }
+}
+
+//Predicts every collision ball i could have with the pockets and cushions
+template <class Spec, class Kernel>
+void predictTable(basicSimulation<Kernel> &sim, int i) {
+  state &cur = sim.cur;
+  if (!onTable(cur, i) || cur.balls[i].vel == vector()) {
+    return;
+  }
+  ball &a = cur.balls[i];
+  const tableOutline &table = outlineOf<Spec>(sim);
+  double horizon = HUGE_VAL;
+  sim.scratch.resize(table.pockets.n);
+  int *near = sim.scratch.data();
+  int found = nearby(table.pockets, 0, table.pockets.n, a, a.stopTime(), near);
+  for(int k = 0; k < found; ++k) {
+    addEvent(sim, collidePocket(a, table.pockets, near[k], horizon), 1, i, near[k]);
+  }
+  sim.cushionTimes.resize(table.cushions.n);
+  cushionContacts(kernelCushions(sim, table), table.cushions, a, Spec::BALL_RADIUS, horizon, sim.cushionTimes.data());
+  for(int j = 0; j < table.cushions.n; ++j) {
+    addEvent(sim, sim.cushionTimes[j], 2, i, j);
+  }
+}
+
+//Fills sim.cluster with balls i and j, every ball touching one of them, every ball touching one of those and so
+//on, and sim.contacts with the touching pairs. A pair counts as touching if it's close enough to meet within
+//CLUSTER_TIME at twice the fastest speed on the table, which is no further than neighbouring cells of the grids
+template <class Spec, class Kernel>
+void gatherCluster(basicSimulation<Kernel> &sim, int i, int j) {
+  state &cur = sim.cur;
+  const ballArrays &b = sim.arrays;
+  std::vector<int> &cluster = sim.cluster;
+  double reach = 2 * Spec::BALL_RADIUS + CONTACT_GAP + 2 * sim.maxSpeed * CLUSTER_TIME;
+  double touch = square(std::min(reach, std::min(sim.resting.cell, sim.broad.cell)));
+  cluster.assign(1, i);
+  cluster.push_back(j);
+  sim.contacts.assign(1, 0);
+  sim.contacts.push_back(1);
+  for(size_t n = 0; n < cluster.size(); ++n) {
+    vector p = cur.balls[cluster[n]].pos;
+    int runs[12];
+    int rows = cellRuns(sim.resting, p, runs);
+    rows += cellRuns(sim.broad, p, runs + 2 * rows);
+    for(int r = 0; r < rows; ++r) {
+      for(int k = runs[2 * r]; k < runs[2 * r + 1]; ++k) {
+        double dx = b.x[k] - p.X, dy = b.y[k] - p.Y;
+        if (b.alive[k] == 0 || dx * dx + dy * dy > touch) continue;
+        size_t m = std::find(cluster.begin(), cluster.end(), b.id[k]) - cluster.begin();
+        if (m == cluster.size()) {
+          cluster.push_back(b.id[k]);
+        }
+        //Each pair is found from both ends, keep it from the one found first
+        if (m > n) {
+          sim.contacts.push_back(n);
+          sim.contacts.push_back(m);
+        }
+      }
+    }
+  }
+}
+
+//Bounces the touching pairs of sim.cluster off each other, pair after pair and pass after pass, until none of
+//them are still closing in. Balls in a rack pass a break along between them here instead of in a step apiece
+//Whatever's left after enough passes gets predicted as ordinary collisions. Sets sim.hit for the balls it moved
+template <class Spec, class Kernel>
+void resolveCluster(basicSimulation<Kernel> &sim) {
+  std::vector<int> &cluster = sim.cluster, &contacts = sim.contacts;
+  sim.hit.assign(cluster.size(), 0);
+  int passes = 4 * cluster.size();
+  bool closing = true;
+  for(int pass = 0; pass < passes && closing; ++pass) {
+    closing = false;
+    for(size_t c = 0; c < contacts.size(); c += 2) {
+      ball &a = sim.cur.balls[cluster[contacts[c]]], &b = sim.cur.balls[cluster[contacts[c + 1]]];
+      //The pair that was predicted to collide always bounces, the rest only if they'd meet within CLUSTER_TIME
+      double dist = abs(b.pos - a.pos), speed = -dot(b.pos - a.pos, b.vel - a.vel) / dist;
+      bool meets = speed > 0 && dist - 2 * Spec::BALL_RADIUS <= CONTACT_GAP + speed * CLUSTER_TIME;
+      if ((pass > 0 || c > 0) && !meets) continue;
+      handleCollide(a, b);
+      sim.hit[contacts[c]] = sim.hit[contacts[c + 1]] = 1;
+      closing = true;
+    }
+  }
+}
+
+//Furthest the fastest ball goes in one window: half the average gap between the balls on the table, so a cell
+//holds about one of them. A ball alone on the table has nothing to meet, so it can go as far as it likes
+template <class Spec>
+double windowTravel(int onTable) {
+  return onTable < 2 ? HUGE_VAL : sqrt(Spec::WIDTH * Spec::HEIGHT / (onTable - 1)) / 2;
+}
+
+//How long the grid can go before it's rebuilt: until the fastest ball has gone windowTravel, and no longer than
+//friction's slack in nearby takes to grow that far
+template <class Spec, class Kernel>
+double windowLength(const basicSimulation<Kernel> &sim, int onTable) {
+  double gap = windowTravel<Spec>(onTable);
+  return std::min(gap / std::max(sim.maxSpeed, 1e-9), sqrt(gap / FRICTION));
+}
+
+//Sets when the window ends, from the balls in sim.binning and out of on balls on the table, and returns how wide
+//broad's cells have to be for it. Every moving ball is in sim.binning, the rest are asleep
+template <class Spec, class Kernel>
+double sizeWindow(basicSimulation<Kernel> &sim, int on) {
+  state &cur = sim.cur;
+  sim.maxSpeed = 0;
+  sim.restTime = cur.time;
+  for(size_t n = 0; n < sim.binning.size(); ++n) {
+    const ball &b = cur.balls[sim.binning[n]];
+    sim.maxSpeed = std::max(sim.maxSpeed, abs(b.vel));
+    sim.restTime = std::max(sim.restTime, cur.time + b.stopTime());
+  }
+  sim.windowEnd = std::min(cur.time + windowLength<Spec>(sim, on), sim.restTime);
+  return 2 * Spec::BALL_RADIUS + 2 * sim.maxSpeed * (sim.windowEnd - cur.time);
+}
+
+//Rebuilds broad for a window of time and predicts each nearby pair of balls once. Pairs of asleep balls are left
+//out, and the asleep balls stay where they are in resting, so this costs as much as the moving balls, however
+//full the table. resting is only rebuilt once it's too fine for the window or most of the still balls aren't in it
+template <class Spec, class Kernel>
+void startWindow(basicSimulation<Kernel> &sim) {
+  state &cur = sim.cur;
+  //Balls woken out of resting have moved since it was built, so they go into broad with the ones already there
+  sim.binning.clear();
+  for(int k = sim.still; k < sim.arrays.n; ++k) {
+    if (onTable(cur, sim.arrays.id[k])) {
+      sim.binning.push_back(sim.arrays.id[k]);
+    }
+  }
+  for(size_t n = 0; n < sim.awake.size(); ++n) {
+    int k = sim.awake[n];
+    sim.woken[k] = 0;
+    if (k < sim.still) {
+      sim.arrays.alive[k] = 0;
+      roundSlot(sim, k);
+      ++sim.stale;
+      if (onTable(cur, sim.arrays.id[k])) {
+        sim.binning.push_back(sim.arrays.id[k]);
+      }
+    }
+  }
+  int on = sim.still - sim.stale + sim.binning.size(), loose = 0;
+  for(size_t n = 0; n < sim.binning.size(); ++n) {
+    loose += asleep(cur, sim.binning[n]);
+  }
+  double cell = sizeWindow<Spec>(sim, on);
+
+  if (cell > sim.resting.cell || 2 * sim.stale > sim.still || 2 * loose > (int) sim.binning.size()) {
+    //resting's cells are made as wide as this window's, which is enough until a ball speeds up or one goes down
+    sim.binning.clear();
+    on = 0;
+    for(int i = 0; i < cur.numballs; ++i) {
+      if (onTable(cur, i) && !asleep(cur, i)) {
+        sim.binning.push_back(i);
+      }
+      on += onTable(cur, i);
+    }
+    cell = sizeWindow<Spec>(sim, on);
+    sim.binning.clear();
+    for(int i = 0; i < cur.numballs; ++i) {
+      if (asleep(cur, i)) {
+        sim.binning.push_back(i);
+      }
+    }
+    binBalls<Spec>(sim, sim.resting, cell, 0);
+    sim.still = sim.binning.size();
+    sim.stale = 0;
+    sim.binning.clear();
+    for(int i = 0; i < cur.numballs; ++i) {
+      if (onTable(cur, i) && !asleep(cur, i)) {
+        sim.binning.push_back(i);
+      }
+    }
+  }
+  sim.arrays.n = sim.still + sim.binning.size();
+  binBalls<Spec>(sim, sim.broad, cell, sim.still);
+
+  sim.awake.clear();
+  for(int k = sim.still; k < sim.arrays.n; ++k) {
+    if (!asleep(cur, sim.arrays.id[k])) {
+      sim.awake.push_back(k);
+      sim.woken[k] = 1;
+    }
+  }
+  for(size_t n = 0; n < sim.awake.size(); ++n) {
+    int i = sim.arrays.id[sim.awake[n]];
+    predictBalls<Spec>(sim, i, i + 1);
+  }
+}
+
+//Starts simulating from a state. Everything in sim is reused, so a simulation that has already run a shot of
+//this size doesn't need to allocate anything for the next one
+template <class Spec = nineFoot, class Kernel>
+void initSimulation(basicSimulation<Kernel> &sim, state beginning) {
+  sim.balls.assign(beginning.balls, beginning.balls + beginning.numballs);
+  sim.cur = beginning;
+  sim.cur.balls = sim.balls.data();
+  sim.events.clear();
+  sim.events.reserve(64 * beginning.numballs);
+  sim.counts.assign(beginning.numballs, 0);
+  sim.frame.resize(beginning.numballs);
+  int cells = (int) (ceil(Spec::WIDTH / (2 * Spec::BALL_RADIUS)) * ceil(Spec::HEIGHT / (2 * Spec::BALL_RADIUS))) + 1;
+  sim.resting.cellStart.reserve(cells);
+  sim.broad.cellStart.reserve(cells);
+  sim.resting.cellOf.reserve(beginning.numballs);
+  sim.broad.cellOf.reserve(beginning.numballs);
+  //A ball woken out of resting keeps its old slot there, dead, until resting is rebuilt, so it can take up two
+  sim.arrays.resize(2 * beginning.numballs);
+  resizeRounded(sim, 2 * beginning.numballs);
+  sim.arrays.n = 0;
+  sim.slot.assign(beginning.numballs, -1);
+  sim.awake.clear();
+  sim.woken.assign(2 * beginning.numballs, 0);
+  sim.binning.reserve(beginning.numballs);
+  //Nothing fits a grid with no cells, so the first window bins every ball
+  sim.resting.cell = 0;
+  sim.still = sim.stale = 0;
+
+  for(int i = 0; i < beginning.numballs; ++i) {
+    predictTable<Spec>(sim, i);
+  }
+  startWindow<Spec>(sim);
+}
+
+//Moves the balls in the given slots along their paths, the same as ball::run but on the arrays
+template <class Scalar>
+void advance(basicBallArrays<Scalar> &b, const std::vector<int> &slots, double dt) {
+  for(size_t s = 0; s < slots.size(); ++s) {
+    int k = slots[s];
+    Scalar step = dt * b.alive[k];
+    Scalar speed = sqrt(b.vx[k] * b.vx[k] + b.vy[k] * b.vy[k]);
+    Scalar t = speed / (Scalar) FRICTION < step ? speed / (Scalar) FRICTION : step;
+    b.x[k] += b.vx[k] * t + b.decelX[k] * t * t;
+    b.y[k] += b.vy[k] * t + b.decelY[k] * t * t;
+    Scalar scale = speed > (Scalar) FRICTION * step ? (speed - (Scalar) FRICTION * step) / speed : 0;
+    b.vx[k] *= scale, b.vy[k] *= scale;
+    b.decelX[k] = scale > 0 ? b.decelX[k] : 0;
+    b.decelY[k] = scale > 0 ? b.decelY[k] : 0;
+  }
+}
+
+//True once every ball has stopped or gone down, after which nothing can happen any more
+template <class Kernel>
+bool atRest(const basicSimulation<Kernel> &sim) {
+  return sim.cur.time >= sim.restTime;
+}
+
+//When the simulation next has something to do: a collision, rebuilding the grid, or coming to rest
+//Stale events are dropped on the way
+template <class Kernel>
+double nextEventTime(basicSimulation<Kernel> &sim) {
+  while (!sim.events.empty() && !isValid(sim, sim.events.front())) {
+    std::pop_heap(sim.events.begin(), sim.events.end());
+    sim.events.pop_back();
+  }
+  double t = std::min(sim.windowEnd, sim.restTime);
+  if (!sim.events.empty() && sim.events.front().time < t) {
+    t = sim.events.front().time;
+  }
+  return t;
+}
+
+//Handles balls i and j colliding, along with everything in contact with them, and predicts again for whichever
+//balls that moved
+template <class Spec, class Kernel>
+void stepCluster(basicSimulation<Kernel> &sim, int i, int j) {
+  state &cur = sim.cur;
+  gatherCluster<Spec>(sim, i, j);
+  resolveCluster<Spec>(sim);
+  bool faster = false;
+  for(size_t n = 0; n < sim.cluster.size(); ++n) {
+    if (!sim.hit[n]) continue;
+    int k = sim.cluster[n];
+    ++sim.counts[k];
+    sim.arrays.store(sim.slot[k], cur.balls[k]);
+    roundSlot(sim, sim.slot[k]);
+    if (!sim.woken[sim.slot[k]]) {
+      sim.awake.push_back(sim.slot[k]);
+      sim.woken[sim.slot[k]] = 1;
+    }
+    sim.restTime = std::max(sim.restTime, cur.time + cur.balls[k].stopTime());
+    predictTable<Spec>(sim, k);
+    faster = faster || abs(cur.balls[k].vel) > sim.maxSpeed;
+  }
+  //A ball sped up past what the grid was sized for, so its neighbours might be further away now
+  if (faster) {
+    startWindow<Spec>(sim);
+    return;
+  }
+  for(size_t n = 0; n < sim.cluster.size(); ++n) {
+    if (sim.hit[n]) {
+      predictBalls<Spec>(sim, sim.cluster[n], 0);
+    }
+  }
+}
+
+//Jumps straight to whatever happens next (but no further than limit) and handles it
+//Only the balls in a collision get their predictions redone, instead of rescanning every pair
+//Returns false without doing anything if the table is at rest or limit has been reached
+template <class Spec = nineFoot, class Kernel>
+bool step(basicSimulation<Kernel> &sim, double limit) {
+  state &cur = sim.cur;
+  sim.lastEvent.type = -1;
+  if (atRest(sim) || cur.time >= limit) {
+    return false;
+  }
+  double t = std::min(nextEventTime(sim), limit);
+  bool collided = !sim.events.empty() && sim.events.front().time <= t;
+  event e;
+  if (collided) {
+    e = sim.events.front();
+    std::pop_heap(sim.events.begin(), sim.events.end());
+    sim.events.pop_back();
+  }
+  double dt = t > cur.time ? t - cur.time : 0;
+  TRACE_COUNT(steps, 1);
+
+  //Asleep balls stay where they are, so only the awake ones need moving
+  advance(sim.arrays, sim.awake, dt);
+  for(size_t k = 0; k < sim.awake.size(); ++k) {
+    sim.arrays.load(sim.awake[k], cur.balls[sim.arrays.id[sim.awake[k]]]);
+    roundMotion(sim, sim.awake[k]);
+  }
+  cur.time += dt;
+
+  if (!collided) {
+    if (cur.time >= sim.windowEnd && !atRest(sim)) {
+      startWindow<Spec>(sim);
+    }
+    return true;
+  }
+  sim.lastEvent = e;
+  int collidei = e.i, collidej = e.j;
+  TRACE_COUNT(events[e.type], 1);
+  TRACE_EVENT(cur.time, e.type, collidei, collidej);
+  if (e.type == 0) {
+    stepCluster<Spec>(sim, collidei, collidej);
+    return true;
+  }
+  if(e.type == 1) {
+    handleCollidePocket(cur.balls[collidei], collidej);
+  }
+  else if (e.type == 2) {
+    handleCollideCushion(cur.balls[collidei], outlineOf<Spec>(sim).cushions, collidej);
+    // handle cushion collision between collidei with cushion collidej
+  }
+  ++sim.counts[collidei];
+  sim.arrays.store(sim.slot[collidei], cur.balls[collidei]);
+  sim.arrays.alive[sim.slot[collidei]] = onTable(cur, collidei);
+  roundSlot(sim, sim.slot[collidei]);
+  if (onTable(cur, collidei)) {
+    sim.restTime = std::max(sim.restTime, cur.time + cur.balls[collidei].stopTime());
+  }
+
+  predictTable<Spec>(sim, collidei);
+  predictBalls<Spec>(sim, collidei, 0);
+  return true;
+}
+
+//The table at time t, which mustn't be past sim's next event. Balls are run forward in closed form from where
+//the simulation last stopped, so frames can be taken at any rate without making the simulation stop for them
+template <class Kernel>
+state sampleAt(basicSimulation<Kernel> &sim, double t) {
+  state &cur = sim.cur;
+  state f = cur;
+  f.time = t;
+  f.balls = sim.frame.data();
+  for(int i = 0; i < cur.numballs; ++i) {
+    sim.frame[i] = cur.balls[i];
+    if (onTable(cur, i) && t > cur.time) {
+      sim.frame[i].run(t - cur.time);
+    }
+  }
+  return f;
+}
+
+//Returns random num from -.5 to .5
+inline double rnd() {
+  return (rand() % 100 - 50) / 100.;
+}
+
+//Returns if x is close enough to an integer
+inline bool isInteger(double x){
+  double epsilon = .0001;
+  double fracPart = x - (int) x;
+  return ((fracPart < epsilon) || (fracPart > 1 - epsilon));
+}
+
+//Receives each frame as it's simulated. The frame's balls belong to the simulation, so copy out what you need
+typedef void (*frameSink)(const state &frame, int index, void *context);
+
+//Simulates from beginning and hands the frames at multiples of DEFAULT_TIME_STEP to sink one at a time
+//Stops after the first frame with everything at rest, or after MAX_ANIMATION_LENGTH. Returns how many frames
+//there were. Nothing is stored, and with a reused sim nothing is allocated either
+template <class Spec = nineFoot, class Kernel>
+int streamStates(basicSimulation<Kernel> &sim, state beginning, frameSink sink, void *context) {
+  int maxFrames = MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1;
+  initSimulation<Spec>(sim, beginning);
+  for(int i = 0; i < maxFrames; ++i) {
+    double t = beginning.time + i * DEFAULT_TIME_STEP;
+    while (nextEventTime(sim) <= t && step<Spec>(sim, t)) {
+    }
+    sink(sampleAt(sim, t), i, context);
+    TRACE_COUNT(frames, 1);
+    if (atRest(sim)) {
+      return i + 1;
+    }
+  }
+  return maxFrames;
+}
+
+//Frames kept in memory the caller owns: room for capacity frames of numballs balls each
+//Once it's full each new frame overwrites the oldest one
+struct frameRing {
+  int capacity, numballs;
+  int count; // frames pushed so far
+  double *times;
+  ball *balls;
+};
+
+inline void initRing(frameRing &ring, double *times, ball *balls, int capacity, int numballs) {
+  ring.capacity = capacity;
+  ring.numballs = numballs;
+  ring.count = 0;
+  ring.times = times;
+  ring.balls = balls;
+}
+
+//frameSink that copies each frame into the frameRing passed as context
+inline void pushFrame(const state &frame, int, void *context) {
+  frameRing &ring = *(frameRing *) context;
+  int k = ring.count % ring.capacity;
+  ring.times[k] = frame.time;
+  for(int j = 0; j < ring.numballs; ++j) {
+    ring.balls[k * ring.numballs + j] = frame.balls[j];
+  }
+  ++ring.count;
+}
+
+//The k-th frame still in the ring, oldest first. Its balls point into the ring
+inline state ringFrame(const frameRing &ring, int k) {
+  int first = ring.count > ring.capacity ? ring.count - ring.capacity : 0;
+  int at = (first + k) % ring.capacity;
+  state s;
+  s.time = ring.times[at];
+  s.numballs = ring.numballs;
+  s.balls = ring.balls + at * ring.numballs;
+  return s;
+}
+
+//A simulation running on its own thread, handing frames over as it makes them, so playback can start before
+//the shot is worked out. Frames go through a ring with one writer (the thread) and one reader (whoever calls
+//pullFrame), so frames are handed over without a lock. Only when the ring is full does the thread sleep on room,
+//and pullFrame then takes the lock to wake it
+struct asyncShot {
+  int capacity, numballs;
+  std::vector<double> times;
+  std::vector<ball> balls; // frame k's balls are balls[(k % capacity) * numballs] onwards
+  std::atomic<long> written, read;
+  std::atomic<bool> cancelled, finished;
+  std::atomic<long> waits; // how many times the thread has gone to sleep on room
+  std::mutex lock;
+  std::condition_variable room; // signalled when a full ring has a frame pulled off it, or on cancelling
+  std::vector<ball> beginning;
+  simulation sim;
+  std::thread thread;
+
+  asyncShot() : capacity(0), numballs(0), written(0), read(0), cancelled(false), finished(true), waits(0) {
+  }
+  ~asyncShot();
+};
+
+//Stops the shot's thread if it's still going and waits for it. Frames already made can still be pulled
+inline void cancelShot(asyncShot &shot) {
+  shot.cancelled.store(true);
+  {
+    std::lock_guard<std::mutex> hold(shot.lock);
+  }
+  shot.room.notify_all();
+  if (shot.thread.joinable()) {
+    shot.thread.join();
+  }
+  shot.finished.store(true, std::memory_order_release);
+}
+
+inline asyncShot::~asyncShot() {
+  cancelShot(*this);
+}
+
+//The thread: the same frames streamStates makes. When the ring is full it sleeps until a frame is pulled
+template <class Spec>
+void asyncLoop(asyncShot &shot, state beginning) {
+  int maxFrames = MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1;
+  initSimulation<Spec>(shot.sim, beginning);
+  for(int i = 0; i < maxFrames; ++i) {
+    double t = beginning.time + i * DEFAULT_TIME_STEP;
+    while (nextEventTime(shot.sim) <= t && step<Spec>(shot.sim, t)) {
+    }
+    //Sequentially consistent against pullFrame's store to read and load of written, so that one of the two
+    //always sees the other: either this sees the room, or pullFrame sees the ring was full and wakes it
+    if (i - shot.read.load() >= shot.capacity) {
+      std::unique_lock<std::mutex> hold(shot.lock);
+      shot.room.wait(hold, [&] {
+        bool go = i - shot.read.load() < shot.capacity || shot.cancelled.load();
+        shot.waits.fetch_add(!go, std::memory_order_relaxed);
+        return go;
+      });
+    }
+    if (shot.cancelled.load(std::memory_order_relaxed)) {
+      return;
+    }
+    state frame = sampleAt(shot.sim, t);
+    int k = i % shot.capacity;
+    shot.times[k] = frame.time;
+    std::copy(frame.balls, frame.balls + shot.numballs, shot.balls.begin() + k * shot.numballs);
+    shot.written.store(i + 1);
+    TRACE_COUNT(frames, 1);
+    if (atRest(shot.sim)) {
+      break;
+    }
+  }
+  shot.finished.store(true, std::memory_order_release);
+}
+
+//Starts simulating beginning on shot's own thread, cancelling whatever shot was running on it before
+//capacity is how many frames can be made ahead of the reader
+template <class Spec = nineFoot>
+void startShot(asyncShot &shot, state beginning, int capacity = 64) {
+  cancelShot(shot);
+  shot.capacity = capacity;
+  shot.numballs = beginning.numballs;
+  shot.times.assign(capacity, 0);
+  shot.balls.resize(capacity * beginning.numballs);
+  shot.beginning.assign(beginning.balls, beginning.balls + beginning.numballs);
+  beginning.balls = shot.beginning.data();
+  shot.written.store(0);
+  shot.read.store(0);
+  shot.cancelled.store(false);
+  shot.finished.store(false);
+  shot.waits.store(0);
+  shot.thread = std::thread(asyncLoop<Spec>, std::ref(shot), beginning);
+}
+
+//Takes the next frame if it's been made yet, with its balls copied to storage (room for numballs)
+//False if it hasn't; shotOver says whether it ever will be
+inline bool pullFrame(asyncShot &shot, state &frame, ball *storage) {
+  long k = shot.read.load(std::memory_order_relaxed);
+  if (k == shot.written.load(std::memory_order_acquire)) {
+    return false;
+  }
+  int at = k % shot.capacity;
+  frame.time = shot.times[at];
+  frame.numballs = shot.numballs;
+  frame.balls = storage;
+  std::copy(shot.balls.begin() + at * shot.numballs, shot.balls.begin() + (at + 1) * shot.numballs, storage);
+  shot.read.store(k + 1);
+  //The thread only ever sleeps on a full ring. Taking the lock means it's either not checked yet or already waiting
+  if (shot.written.load() - k >= shot.capacity) {
+    {
+      std::lock_guard<std::mutex> hold(shot.lock);
+    }
+    shot.room.notify_one();
+  }
+  return true;
+}
+
+//True once there are no more frames to pull: the balls stopped (or it was cancelled) and every frame made was pulled
+inline bool shotOver(const asyncShot &shot) {
+  return shot.finished.load(std::memory_order_acquire) && shot.read.load() == shot.written.load();
+}
+
+//One ball's path from time on: it sets off from pos at vel and slows down from there the same as ball::run
+//Scalar is what it's stored as. The simulation itself always runs in double
+template <class Scalar>
+struct basicKeyframe {
+  Scalar time;
+  std::complex<Scalar> pos, vel;
+  int inPocket;
+};
+
+//A whole shot stored as the moments each ball's path changed. In between every ball moves in closed form,
+//so these are enough to get the table at any time, without keeping hundreds of frames around
+template <class Scalar>
+struct basicTrajectory {
+  int numballs;
+  double start, end;
+  std::vector<basicKeyframe<Scalar> > keys; // grouped by ball, each ball's in time order
+  std::vector<int> first;     // ball i's keys are keys[first[i]] up to keys[first[i + 1]]
+  std::vector<ball> balls;    // the balls at the start, for their ids
+};
+
+typedef basicKeyframe<double> keyframe;
+typedef basicTrajectory<double> trajectory;
+//Half the memory of a trajectory, 24 bytes a keyframe instead of 48, for keeping many shots around. Positions
+//read back from one are within a micrometre of the double ones on the benchmark's shots, see bench.cpp
+typedef basicTrajectory<float> floatTrajectory;
+
+template <class Scalar>
+void addKeyframe(std::vector<std::pair<int, basicKeyframe<Scalar> > > &log, int i, double time, const ball &b) {
+  basicKeyframe<Scalar> k;
+  k.time = time;
+  k.pos = std::complex<Scalar>(b.pos);
+  k.vel = std::complex<Scalar>(b.inPocket == -1 ? b.vel : vector()); // balls stay put once they're in a pocket
+  k.inPocket = b.inPocket;
+  log.push_back(std::make_pair(i, k));
+}
+
+//How much work recordPreview may do before handing back what it has. 0 means no limit
+struct previewBudget {
+  double seconds; // wall clock
+  int steps;      // calls to step
+  int collisions; // ball, pocket and cushion hits, for a cheap look at just the start of a shot
+};
+
+//recordTrajectory that stops early once budget runs out, for previews that have to be on time more than complete
+//out has everything up to out.end. Past that balls just roll on as if there were nothing left to hit
+//Returns whether the table came to rest, ie out is the whole shot
+template <class Spec = nineFoot, class Kernel, class Scalar>
+bool recordPreview(basicSimulation<Kernel> &sim, state beginning, double duration, const previewBudget &budget, basicTrajectory<Scalar> &out) {
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(budget.seconds));
+  int n = beginning.numballs, steps = 0, collisions = 0;
+  std::vector<std::pair<int, basicKeyframe<Scalar> > > log;
+  initSimulation<Spec>(sim, beginning);
+  for(int i = 0; i < n; ++i) {
+    addKeyframe(log, i, beginning.time, beginning.balls[i]);
+  }
+  double end = beginning.time + duration;
+  while ((budget.steps == 0 || steps < budget.steps) && (budget.collisions == 0 || collisions < budget.collisions) &&
+         step<Spec>(sim, end)) {
+    ++steps;
+    event &e = sim.lastEvent;
+    if (e.type != -1) {
+      ++collisions;
+    }
+    if (e.type == 0) {
+      for(size_t k = 0; k < sim.cluster.size(); ++k) {
+        if (sim.hit[k]) {
+          addKeyframe(log, sim.cluster[k], sim.cur.time, sim.cur.balls[sim.cluster[k]]);
+        }
+      }
+    } else if (e.type != -1) {
+      addKeyframe(log, e.i, sim.cur.time, sim.cur.balls[e.i]);
+    }
+    if (budget.seconds > 0 && std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+  }
+
+  //Group by ball, keeping each ball's keyframes in the order they happened
+  out.numballs = n;
+  out.start = beginning.time;
+  out.end = sim.cur.time;
+  out.balls.assign(beginning.balls, beginning.balls + n);
+  out.first.assign(n + 1, 0);
+  for(size_t k = 0; k < log.size(); ++k) {
+    ++out.first[log[k].first + 1];
+  }
+  for(int i = 0; i < n; ++i) {
+    out.first[i + 1] += out.first[i];
+  }
+  std::vector<int> fill(out.first.begin(), out.first.end() - 1);
+  out.keys.resize(log.size());
+  for(size_t k = 0; k < log.size(); ++k) {
+    out.keys[fill[log[k].first]++] = log[k].second;
+  }
+  return atRest(sim);
+}
+
+//Simulates from beginning for duration and records every collision into out
+template <class Spec = nineFoot, class Kernel, class Scalar>
+void recordTrajectory(basicSimulation<Kernel> &sim, state beginning, double duration, basicTrajectory<Scalar> &out) {
+  previewBudget unlimited = {0, 0, 0};
+  recordPreview<Spec>(sim, beginning, duration, unlimited, out);
+}
+
+//Where ball i is at time t: binary search for its last keyframe before t, then run it forward from there
+template <class Scalar>
+ball trajectoryBall(const basicTrajectory<Scalar> &tr, int i, double t) {
+  const basicKeyframe<Scalar> *lo = &tr.keys[tr.first[i]], *hi = &tr.keys[tr.first[i + 1]];
+  while (hi - lo > 1) {
+    const basicKeyframe<Scalar> *mid = lo + (hi - lo) / 2;
+    if (mid->time <= t) lo = mid;
+    else hi = mid;
+  }
+  const basicKeyframe<Scalar> *k = lo;
+  ball b = tr.balls[i];
+  b.pos = vector(k->pos);
+  b.vel = vector(k->vel);
+  b.inPocket = k->inPocket;
+  if (t > k->time) {
+    b.run(t - k->time);
+  }
+  return b;
+}
+
+//The whole table at time t, with the balls written to storage. O(numballs * log(keyframes per ball))
+template <class Scalar>
+state trajectoryAt(const basicTrajectory<Scalar> &tr, double t, ball *storage) {
+  state s;
+  s.time = t;
+  s.numballs = tr.numballs;
+  s.balls = storage;
+  for(int i = 0; i < tr.numballs; ++i) {
+    storage[i] = trajectoryBall(tr, i, t);
+  }
+  return s;
+}
+
+//frameSink for allStates: copies each frame into its own malloc'd slot of the state list passed as context
+inline void storeFrame(const state &frame, int index, void *context) {
+  state *stateList = (state *) context;
+  stateList[index] = frame;
+  stateList[index].balls = (ball*) malloc(sizeof(ball) * frame.numballs);
+  for(int j = 0; j < frame.numballs; ++j) {
+    stateList[index].balls[j] = frame.balls[j];
+  }
+}
+
+//Main method for the API
+//Returns an array of all the states, free it with freeStates. It stops once the balls do, so if numFrames is
+//given it gets how many frames there actually are
+template <class Spec = nineFoot>
+state* allStates(state beginning, int *numFrames = NULL) {
+  int maxFrames = MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1;
+  state *stateList = new state[maxFrames]();
+  simulation sim;
+  int count = streamStates<Spec>(sim, beginning, storeFrame, stateList);
+  if (numFrames) {
+    *numFrames = count;
+  }
+  return stateList;
+}
+
+//frameSink for the allStates below: appends a snapshot of each frame to the vector of fixedState<N> or
+//dynamicState passed as context
+template <class Snapshot>
+void snapshotFrame(const state &frame, int, void *context) {
+  ((std::vector<Snapshot> *) context)->push_back(Snapshot(frame));
+}
+
+//The same frames as snapshots that own their balls, all of them in frames' one buffer instead of a malloc each
+//Returns how many there are
+template <class Spec = nineFoot, class Snapshot>
+int allStates(state beginning, std::vector<Snapshot> &frames) {
+  frames.clear();
+  simulation sim;
+  return streamStates<Spec>(sim, beginning, snapshotFrame<Snapshot>, &frames);
+}
+
+inline void freeStates(state *stateList, int numFrames) {
+  for(int i = 0; i < numFrames; ++i) {
+    free(stateList[i].balls);
+  }
+  delete[] stateList;
+}
+
+//What a shot came to: where every ball ended up (inPocket says which went down, balls[0] in one is a scratch),
+//the ball the cue ball hit first, -1 for none, and what that ball was sent off at
+//If a stopRule cut it short, stopped says which STOP_ it was, and balls are where they were at that moment
+struct outcome {
+  double time;
+  std::vector<ball> balls;
+  int firstContact;
+  vector firstVel;
+  int stopped;
+};
+
+//Reasons to stop simulating a shot as soon as its result is known, for callers that only want one thing from it
+const int STOP_SCRATCH = 1;     // the cue ball went in
+const int STOP_POTTED = 2;      // target went in
+const int STOP_WRONG_FIRST = 4; // the cue ball hit some other ball before target
+
+struct stopRule {
+  int when; // STOP_ flags or'd together
+  int target;
+};
+
+const stopRule NO_STOP = {0, -1};
+
+//Simulates the cue ball (balls[0]) hit at cueVel from beginning for as long as allStates would, or until one of
+//stop's rules says there's no point going on. Takes no frames, only the outcome
+//sim and balls are scratch space, so reusing them across shots saves reallocating
+template <class Spec = nineFoot, class Kernel>
+void simulateOutcome(basicSimulation<Kernel> &sim, std::vector<ball> &balls, state beginning, vector cueVel, const stopRule &stop, outcome &out) {
+  balls.assign(beginning.balls, beginning.balls + beginning.numballs);
+  balls[0].vel = cueVel;
+  state s = beginning;
+  s.balls = balls.data();
+  initSimulation<Spec>(sim, s);
+  out.firstContact = -1;
+  out.firstVel = vector();
+  out.stopped = 0;
+  double end = beginning.time + MAX_ANIMATION_LENGTH;
+  while (!out.stopped && step<Spec>(sim, end)) {
+    const event &e = sim.lastEvent;
+    if (e.type == 0 && out.firstContact == -1 && (e.i == 0 || e.j == 0)) {
+      out.firstContact = e.i + e.j;
+      out.firstVel = sim.cur.balls[out.firstContact].vel;
+      if (stop.when & STOP_WRONG_FIRST && out.firstContact != stop.target) {
+        out.stopped = STOP_WRONG_FIRST;
+      }
+    } else if (e.type == 1 && e.i == 0 && stop.when & STOP_SCRATCH) {
+      out.stopped = STOP_SCRATCH;
+    } else if (e.type == 1 && e.i == stop.target && stop.when & STOP_POTTED) {
+      out.stopped = STOP_POTTED;
+    }
+  }
+  out.time = sim.cur.time;
+  out.balls.assign(sim.balls.begin(), sim.balls.end());
+}
+
+//simulateOutcome all the way to the balls stopping
+template <class Spec = nineFoot, class Kernel>
+void simulateShot(basicSimulation<Kernel> &sim, std::vector<ball> &balls, state beginning, vector cueVel, outcome &out) {
+  simulateOutcome<Spec>(sim, balls, beginning, cueVel, NO_STOP, out);
+}
+
+//Thread pool for simulating many shots from one table at once
+//Each worker gets an even share of a batch up front and its own scratch simulation. When its share runs out it
+//steals from the back of another worker's, so a few long shots (breaks, multi-rail) don't leave the rest idle
+//Kernel is the scalar type the workers' simulations prune in, as for basicSimulation
+template <class Kernel = double>
+struct basicShotPool {
+  struct worker {
+    std::mutex lock;
+    std::deque<int> shots;
+    basicSimulation<Kernel> sim;
+    std::vector<ball> balls;
+  };
+
+  std::vector<std::unique_ptr<worker> > workers;
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  std::condition_variable wake, done;
+  int batch;   // bumped for every batch so sleeping workers know there's work
+  int running; // workers still on the current batch
+  bool quit;
+
+  //The current batch
+  void (*simulate)(basicSimulation<Kernel> &sim, std::vector<ball> &balls, state beginning, vector cueVel, const stopRule &stop,
+                   outcome &out);
+  state beginning;
+  const vector *cueVels;
+  const stopRule *stops;
+  outcome *outs;
+
+  basicShotPool(int numThreads = std::thread::hardware_concurrency());
+  ~basicShotPool();
+};
+
+typedef basicShotPool<double> shotPool;
+typedef basicShotPool<floatKernel> floatShotPool;
+
+//Takes the next shot for worker me, from its own share if it has any left and otherwise stolen from someone else's
+template <class Kernel>
+bool takeShot(basicShotPool<Kernel> &pool, int me, int &shot) {
+  int n = pool.workers.size();
+  for(int k = 0; k < n; ++k) {
+    typename basicShotPool<Kernel>::worker &w = *pool.workers[(me + k) % n];
+    std::lock_guard<std::mutex> guard(w.lock);
+    if (!w.shots.empty()) {
+      if (k == 0) {
+        shot = w.shots.front();
+        w.shots.pop_front();
+      } else {
+        shot = w.shots.back();
+        w.shots.pop_back();
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+template <class Kernel>
+void workerLoop(basicShotPool<Kernel> &pool, int me) {
+  int seen = 0;
+  typename basicShotPool<Kernel>::worker &w = *pool.workers[me];
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(pool.lock);
+      while (!pool.quit && pool.batch == seen) {
+        pool.wake.wait(guard);
+      }
+      if (pool.quit) {
+        return;
+      }
+      seen = pool.batch;
+    }
+    int shot;
+    while (takeShot(pool, me, shot)) {
+      pool.simulate(w.sim, w.balls, pool.beginning, pool.cueVels[shot], pool.stops ? pool.stops[shot] : NO_STOP, pool.outs[shot]);
+    }
+    std::lock_guard<std::mutex> guard(pool.lock);
+    if (--pool.running == 0) {
+      pool.done.notify_all();
+    }
+  }
+}
+
+template <class Kernel>
+basicShotPool<Kernel>::basicShotPool(int numThreads) {
+  batch = 0;
+  running = 0;
+  quit = false;
+  if (numThreads < 1) {
+    numThreads = 1;
+  }
+  for(int k = 0; k < numThreads; ++k) {
+    workers.push_back(std::unique_ptr<worker>(new worker()));
+  }
+  for(int k = 0; k < numThreads; ++k) {
+    threads.push_back(std::thread(workerLoop<Kernel>, std::ref(*this), k));
+  }
+}
+
+template <class Kernel>
+basicShotPool<Kernel>::~basicShotPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quit = true;
+  }
+  wake.notify_all();
+  for(size_t k = 0; k < threads.size(); ++k) {
+    threads[k].join();
+  }
+}
+
+//Simulates the same table with the cue ball hit at each of numShots velocities, and waits for all of them
+//outs[k] gets the outcome of cueVels[k], cut short by stops[k] if there are stops
+template <class Spec = nineFoot, class Kernel>
+void simulateBatch(basicShotPool<Kernel> &pool, state beginning, const vector *cueVels, int numShots, outcome *outs, const stopRule *stops = NULL) {
+  int n = pool.workers.size();
+  for(int k = 0; k < n; ++k) {
+    std::lock_guard<std::mutex> guard(pool.workers[k]->lock);
+    for(int shot = (long long) numShots * k / n; shot < (long long) numShots * (k + 1) / n; ++shot) {
+      pool.workers[k]->shots.push_back(shot);
+    }
+  }
+  std::unique_lock<std::mutex> guard(pool.lock);
+  pool.simulate = simulateOutcome<Spec, Kernel>;
+  pool.beginning = beginning;
+  pool.cueVels = cueVels;
+  pool.stops = stops;
+  pool.outs = outs;
+  pool.running = n;
+  ++pool.batch;
+  pool.wake.notify_all();
+  while (pool.running > 0) {
+    pool.done.wait(guard);
+  }
+}
+
+//Exact hash of a table, down to the last bit of every position, for caching what happens on it
+inline unsigned long long stateKey(state s) {
+  unsigned long long h = 1469598103934665603ULL;
+  for(int i = 0; i < s.numballs; ++i) {
+    double parts[2] = {s.balls[i].pos.X, s.balls[i].pos.Y};
+    unsigned long long bits[2];
+    memcpy(bits, parts, sizeof(bits));
+    h = (h ^ bits[0]) * 1099511628211ULL;
+    h = (h ^ bits[1]) * 1099511628211ULL;
+    h = (h ^ (unsigned long long) (s.balls[i].inPocket + 1)) * 1099511628211ULL;
+  }
+  return h;
+}
+
+//Simulates shots while the player is still aiming, so there's nothing left to do when they let go
+//aimAt says where the aim is now, and a background thread records the aims around it, nearest first, into an
+//LRU cache keyed by the table, angle and power. Aims are rounded to one of angles directions and a multiple of
+//powerStep, so the shot that gets played is the rounded one, the same one that was speculated on
+//A session is for one kind of table at a time, changing Spec empties the cache
+struct aimSession {
+  struct key {
+    unsigned long long table;
+    long long angle, power;
+    bool operator==(const key &o) const {
+      return table == o.table && angle == o.angle && power == o.power;
+    }
+  };
+  struct keyHash {
+    size_t operator()(const key &k) const {
+      return (size_t) ((k.table ^ (unsigned long long) k.angle * 0x9E3779B97F4A7C15ULL) * 1099511628211ULL ^ k.power);
+    }
+  };
+  typedef std::list<std::pair<key, std::shared_ptr<const trajectory> > > lruList;
+
+  int angles;       // directions in a full turn
+  double powerStep; // in m/s
+  int spread;       // neighbouring directions to speculate on either side
+  size_t capacity;  // trajectories kept
+
+  std::thread thread;
+  std::mutex lock;
+  std::condition_variable wake, recorded;
+  lruList lru; // most recently used first
+  std::unordered_map<key, lruList::iterator, keyHash> cache;
+  void (*record)(simulation &sim, state beginning, double duration, trajectory &out);
+  bool quit;
+
+  //What's being aimed at, if anything. table.balls points into balls
+  bool aiming;
+  key aim;
+  std::vector<ball> balls;
+  state table;
+  bool busy;   // the thread is recording working
+  key working;
+
+  long hits, misses;
+
+  aimSession(int angles = 4096, double powerStep = 0.02, int spread = 8, size_t capacity = 512);
+  ~aimSession();
+};
+
+//The cue ball velocity an aim stands for
+inline vector aimVelocity(const aimSession &s, aimSession::key k) {
+  double angle = 2 * M_PI * k.angle / s.angles;
+  return k.power * s.powerStep * vector(cos(angle), sin(angle));
+}
+
+inline aimSession::key aimKey(const aimSession &s, state cur, double angle, double power) {
+  aimSession::key k;
+  k.table = stateKey(cur);
+  k.angle = ((llround(angle * s.angles / (2 * M_PI)) % s.angles) + s.angles) % s.angles;
+  k.power = std::max(1LL, llround(power / s.powerStep));
+  return k;
+}
+
+//Looks up k and marks it most recently used. Call with s.lock held
+inline std::shared_ptr<const trajectory> cachedAim(aimSession &s, const aimSession::key &k) {
+  std::unordered_map<aimSession::key, aimSession::lruList::iterator, aimSession::keyHash>::iterator it = s.cache.find(k);
+  if (it == s.cache.end()) {
+    return std::shared_ptr<const trajectory>();
+  }
+  s.lru.splice(s.lru.begin(), s.lru, it->second);
+  return it->second->second;
+}
+
+//Adds k, dropping the least recently used trajectory if the cache is full. Call with s.lock held
+inline void cacheAim(aimSession &s, const aimSession::key &k, const std::shared_ptr<const trajectory> &tr) {
+  if (s.cache.count(k)) {
+    return;
+  }
+  s.lru.push_front(std::make_pair(k, tr));
+  s.cache[k] = s.lru.begin();
+  if (s.lru.size() > s.capacity) {
+    s.cache.erase(s.lru.back().first);
+    s.lru.pop_back();
+  }
+}
+
+//The nearest aim to s.aim that isn't cached: the aim itself, then a direction either side and a power either side,
+//then further out in direction up to s.spread. Call with s.lock held
+inline bool nextAim(aimSession &s, aimSession::key &out) {
+  for(int d = 0; d <= s.spread; ++d) {
+    for(int k = 0; k < (d == 0 ? 1 : d == 1 ? 4 : 2); ++k) {
+      out = s.aim;
+      if (k < 2) {
+        out.angle = ((out.angle + (k ? -d : d)) % s.angles + s.angles) % s.angles;
+      } else {
+        out.power += k == 2 ? 1 : -1;
+      }
+      if (out.power > 0 && !s.cache.count(out)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+inline void aimLoop(aimSession &s) {
+  simulation sim;
+  std::vector<ball> balls;
+  std::unique_lock<std::mutex> guard(s.lock);
+  while (true) {
+    aimSession::key k;
+    while (!s.quit && !(s.aiming && nextAim(s, k))) {
+      s.wake.wait(guard);
+    }
+    if (s.quit) {
+      return;
+    }
+    s.busy = true;
+    s.working = k;
+    balls = s.balls;
+    state beginning = s.table;
+    void (*record)(simulation &, state, double, trajectory &) = s.record;
+    guard.unlock();
+
+    balls[0].vel = aimVelocity(s, k);
+    beginning.balls = balls.data();
+    std::shared_ptr<trajectory> tr(new trajectory());
+    record(sim, beginning, MAX_ANIMATION_LENGTH, *tr);
+
+    guard.lock();
+    s.busy = false;
+    if (record == s.record) {
+      cacheAim(s, k, tr);
+    }
+    s.recorded.notify_all();
+  }
+}
+
+inline aimSession::aimSession(int angles, double powerStep, int spread, size_t capacity)
+    : angles(angles), powerStep(powerStep), spread(spread), capacity(capacity) {
+  record = NULL;
+  quit = false;
+  aiming = false;
+  busy = false;
+  hits = misses = 0;
+  thread = std::thread(aimLoop, std::ref(*this));
+}
+
+inline aimSession::~aimSession() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quit = true;
+  }
+  wake.notify_all();
+  thread.join();
+}
+
+//Switches s over to Spec's tables, emptying the cache if it was on another kind. Call with s.lock held
+template <class Spec>
+void aimTable(aimSession &s) {
+  if (s.record != recordTrajectory<Spec, double, double>) {
+    s.record = recordTrajectory<Spec, double, double>;
+    s.cache.clear();
+    s.lru.clear();
+  }
+}
+
+//Call as the aim moves: the cue ball (cur.balls[0]) would be hit at angle with speed power
+//Returns straight away, the speculating happens on s's thread
+template <class Spec = nineFoot>
+void aimAt(aimSession &s, state cur, double angle, double power) {
+  aimSession::key k = aimKey(s, cur, angle, power);
+  {
+    std::lock_guard<std::mutex> guard(s.lock);
+    aimTable<Spec>(s);
+    if (!s.aiming || k.table != s.aim.table) {
+      s.balls.assign(cur.balls, cur.balls + cur.numballs);
+      s.table = cur;
+      s.table.balls = s.balls.data();
+    }
+    s.aim = k;
+    s.aiming = true;
+  }
+  s.wake.notify_one();
+}
+
+//Call when the shot is played: the trajectory of the rounded aim, from the cache if it was speculated on, waited
+//for if it's being recorded right now, and recorded here otherwise. Speculating stops until the next aimAt
+template <class Spec = nineFoot>
+std::shared_ptr<const trajectory> releaseAim(aimSession &s, state cur, double angle, double power) {
+  aimSession::key k = aimKey(s, cur, angle, power);
+  std::unique_lock<std::mutex> guard(s.lock);
+  aimTable<Spec>(s);
+  s.aiming = false;
+  std::shared_ptr<const trajectory> tr;
+  while (!(tr = cachedAim(s, k)) && s.busy && s.working == k) {
+    s.recorded.wait(guard);
+  }
+  if (tr) {
+    ++s.hits;
+    return tr;
+  }
+  ++s.misses;
+  guard.unlock();
+
+  std::vector<ball> balls(cur.balls, cur.balls + cur.numballs);
+  balls[0].vel = aimVelocity(s, k);
+  state beginning = cur;
+  beginning.balls = balls.data();
+  simulation sim;
+  std::shared_ptr<trajectory> out(new trajectory());
+  recordTrajectory<Spec>(sim, beginning, MAX_ANIMATION_LENGTH, *out);
+
+  guard.lock();
+  cacheAim(s, k, out);
+  return out;
+}
+
+//If a ball goes on a straight line path from ball a to ball b, will there be miscellaneous collisions?
+template <class Spec>
+bool isCollision(state cur, ball a, ball b){
+  for(int i = 0; i < cur.numballs; ++i){
+    ball c = cur.balls[i];
+    if(c.pos != a.pos && c.pos != b.pos){
+      vector bRel = b.pos - a.pos;
+      vector cRel = c.pos - a.pos;
+      double perpDist =  abs(cRel - proj(cRel, bRel));
+      if(perpDist < 2 * Spec::BALL_RADIUS && dot(bRel, cRel) > 0 && dot(bRel, b.pos - c.pos) > 0) {return true;}
+    }
+  }
+  return false;
+}
+
+//What can block a straight path out of each ball, built once per state so the planner's line of sight checks
+//take O(log n) instead of isCollision's O(n)
+//Every other ball covers an arc of directions out of a ball: the ones a ball rolling out would pass within two
+//radii of it. The arcs' ends cut the circle into pieces, and each piece lists the balls covering it, nearest first
+struct sightIndex {
+  double reach;                // 2 radii, how close a path has to pass to be blocked
+  std::vector<vector> pos;     // the state's balls
+  std::vector<int> pieceStart; // ball i's pieces are pieceStart[i] up to pieceStart[i + 1]
+  std::vector<double> pieceEnd; // the angle each piece ends at, going round from -pi to pi
+  std::vector<int> coverStart; // piece p is covered by cover[coverStart[p]] up to cover[coverStart[p + 1]]
+  std::vector<int> cover;
+};
+
+template <class Spec>
+void buildSight(sightIndex &s, state cur) {
+  int n = cur.numballs;
+  s.reach = 2 * Spec::BALL_RADIUS;
+  s.pos.resize(n);
+  for(int i = 0; i < n; ++i) {
+    s.pos[i] = cur.balls[i].pos;
+  }
+  s.pieceStart.assign(1, 0);
+  s.pieceEnd.clear();
+  s.coverStart.assign(1, 0);
+  s.cover.clear();
+  //Where each ball's arc starts and stops covering, in angle order with the starts first at each angle
+  struct edge {
+    double angle, dist;
+    int id, closing;
+    bool operator<(const edge &other) const {
+      return angle != other.angle ? angle < other.angle : closing < other.closing;
+    }
+  };
+  std::vector<edge> edges;
+  std::vector<std::pair<double, int> > covering;
+  for(int i = 0; i < n; ++i) {
+    edges.clear();
+    for(int c = 0; c < n; ++c) {
+      vector rel = s.pos[c] - s.pos[i];
+      if (rel == vector()) {
+        continue;
+      }
+      //Widened a touch so rounding can only let in balls that the exact test then turns away
+      double dist = abs(rel), mid = atan2(rel.Y, rel.X);
+      double half = (dist > s.reach ? asin(s.reach / dist) : M_PI / 2) + 1e-9;
+      double lo = mid - half, hi = mid + half;
+      if (lo < -M_PI) {
+        edge wrap[2] = {{lo + 2 * M_PI, dist, c, 0}, {M_PI, dist, c, 1}};
+        edges.insert(edges.end(), wrap, wrap + 2);
+        lo = -M_PI;
+      } else if (hi > M_PI) {
+        edge wrap[2] = {{-M_PI, dist, c, 0}, {hi - 2 * M_PI, dist, c, 1}};
+        edges.insert(edges.end(), wrap, wrap + 2);
+        hi = M_PI;
+      }
+      edge ends[2] = {{lo, dist, c, 0}, {hi, dist, c, 1}};
+      edges.insert(edges.end(), ends, ends + 2);
+    }
+    std::sort(edges.begin(), edges.end());
+
+    //Sweep round from -pi, keeping the balls whose arcs cover the way ahead sorted nearest first. A piece ends
+    //wherever an arc starts or stops
+    covering.clear();
+    double from = -M_PI;
+    size_t e = 0;
+    while (from < M_PI) {
+      for(; e < edges.size() && edges[e].angle <= from; ++e) {
+        std::pair<double, int> c(edges[e].dist, edges[e].id);
+        std::vector<std::pair<double, int> >::iterator at = std::lower_bound(covering.begin(), covering.end(), c);
+        if (edges[e].closing) {
+          covering.erase(at);
+        } else {
+          covering.insert(at, c);
+        }
+      }
+      double to = e < edges.size() ? edges[e].angle : M_PI;
+      for(size_t a = 0; a < covering.size(); ++a) {
+        s.cover.push_back(covering[a].second);
+      }
+      s.pieceEnd.push_back(to);
+      s.coverStart.push_back(s.cover.size());
+      from = to;
+    }
+    s.pieceStart.push_back(s.pieceEnd.size());
+  }
+}
+
+//Whether a ball rolling straight from ball from to the point to would hit another ball on the way, the same
+//test as isCollision: only balls in the piece the path heads out through can block it, and once they're further
+//away than the path is long none of the rest can
+inline bool pathBlocked(const sightIndex &s, int from, vector to) {
+  vector path = to - s.pos[from];
+  double length = abs(path);
+  double angle = atan2(path.Y, path.X);
+  int first = s.pieceStart[from], last = s.pieceStart[from + 1] - 1;
+  int p = std::upper_bound(s.pieceEnd.begin() + first, s.pieceEnd.begin() + last, angle) - s.pieceEnd.begin();
+  for(int k = s.coverStart[p]; k < s.coverStart[p + 1]; ++k) {
+    vector c = s.pos[s.cover[k]];
+    vector cRel = c - s.pos[from];
+    if (abs(cRel) - s.reach >= length) {
+      break;
+    }
+    double perpDist = abs(cRel - proj(cRel, path));
+    if (c != to && perpDist < s.reach && dot(path, cRel) > 0 && dot(path, to - c) > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//Hit ball a to hit ball b to go on a straight line path to c - return the unit vector at which we hit the first ball (radians)
+//If the such path intersects something else on the way, return -10
+template <class Spec>
+double directShot(const sightIndex &sight, int a, int b, vector c){
+  vector cRelB = c - sight.pos[b];
+  vector ghostBall = sight.pos[b] - 2 * Spec::BALL_RADIUS * cRelB / abs(cRelB);
+  if(pathBlocked(sight, a, ghostBall) || pathBlocked(sight, b, c)){ return -10;}
+  vector path = ghostBall - sight.pos[a];
+  return atan2(path.Y, path.X);
+}
+
+//Same thing as above, just with a combo: a into b into c, which goes to d
+template <class Spec>
+double comboShot(const sightIndex &sight, int a, int b, int c, vector d){
+  vector dRelC = d - sight.pos[c];
+  vector ghostBall = sight.pos[c] - 2 * Spec::BALL_RADIUS * dRelC / abs(dRelC);
+  if(pathBlocked(sight, c, d)) { return -10;}
+  return directShot<Spec>(sight, a, b, ghostBall);
+}
+
+//Like pathBlocked, but from any point rather than a ball, so it checks every ball. For the legs of a bank or kick
+//after a cushion; ignore is the ball travelling them, which isn't where it started any more
+inline bool pointBlocked(const sightIndex &s, vector from, vector to, int ignore) {
+  vector path = to - from;
+  for(int i = 0; i < (int) s.pos.size(); ++i) {
+    vector c = s.pos[i];
+    if (i == ignore || c == from || c == to) continue;
+    vector cRel = c - from;
+    double perpDist = abs(cRel - proj(cRel, path));
+    if (perpDist < s.reach && dot(path, cRel) > 0 && dot(path, to - c) > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//A rail to bank off, as the line ball centers bounce off: the cushion moved out onto the table by a ball's
+//radius. p is on the line, u runs along it and n points onto the table. Bounces between from and to along it
+//are clear of the knuckles
+struct bankRail {
+  vector p, u, n;
+  double from, to, res;
+};
+
+//The rails of a tableSpec, built the first time they're asked for. Pocket walls are too short to bank off
+template <class Spec>
+std::vector<bankRail> buildRails() {
+  std::vector<bankRail> rails;
+  const segmentArrays &c = specOutline<Spec>().cushions;
+  double r = Spec::BALL_RADIUS;
+  for(int k = 0; k < c.n; ++k) {
+    if (c.len[k] < 10 * r) continue;
+    bankRail rail;
+    rail.n = vector(c.nx[k], c.ny[k]);
+    rail.u = vector(c.ux[k], c.uy[k]);
+    rail.p = vector(c.x1[k], c.y1[k]) + r * rail.n;
+    rail.from = r;
+    rail.to = c.len[k] - r;
+    rail.res = c.res[k];
+    rails.push_back(rail);
+  }
+  return rails;
+}
+
+template <class Spec>
+const std::vector<bankRail> &specRails() {
+  static const std::vector<bankRail> rails = buildRails<Spec>();
+  return rails;
+}
+
+//Mirror image of t in rail r, pushed back by 1 / res: a bounce keeps res of the speed into the rail and all of
+//the speed along it, so a straight line to this image bends at the rail exactly the way the ball will
+inline vector mirror(const bankRail &r, vector t) {
+  double d = dot(t - r.p, r.n);
+  return t - (d + d / r.res) * r.n;
+}
+
+//Where a ball going from o towards image crosses rail r. False if it doesn't come at the rail from the table,
+//comes in too shallow to trust, or lands off the clean part of the rail
+inline bool bouncePoint(const bankRail &r, vector o, vector image, vector &hit) {
+  double d0 = dot(o - r.p, r.n), d1 = dot(image - r.p, r.n);
+  if (d0 <= 0 || d1 >= 0 || d0 - d1 < 0.15 * abs(image - o)) {
+    return false;
+  }
+  hit = o + (image - o) * (d0 / (d0 - d1));
+  double along = dot(hit - r.p, r.u);
+  return along >= r.from && along <= r.to;
+}
+
+//Bounce points of a path from o to t off rails seq[0] and then seq[1] (n is 1 or 2). Works back from t,
+//mirroring it in each rail in turn, so every leg is a straight line to an image
+inline bool bouncePath(const std::vector<bankRail> &rails, const int *seq, int n, vector o, vector t, vector *hits) {
+  vector images[2];
+  vector image = t;
+  for(int k = n - 1; k >= 0; --k) {
+    images[k] = image = mirror(rails[seq[k]], image);
+  }
+  vector from = o;
+  for(int k = 0; k < n; ++k) {
+    if (!bouncePoint(rails[seq[k]], from, images[k], hits[k])) {
+      return false;
+    }
+    from = hits[k];
+  }
+  return true;
+}
+
+//Bank: hit ball a into ball b, which goes off the rails in seq into the pocket at c. Returns the angle to hit a at,
+//or -10 if it can't be made. Everything that's just arithmetic (the bounces, the cut, whether reach is enough
+//roll for the whole path) is checked before any line of sight
+template <class Spec>
+double bankShot(const sightIndex &sight, int a, int b, vector c, const int *seq, int n, double reach) {
+  vector hits[2];
+  if (!bouncePath(specRails<Spec>(), seq, n, sight.pos[b], c, hits)) {
+    return -10;
+  }
+  vector out = (hits[0] - sight.pos[b]) / abs(hits[0] - sight.pos[b]);
+  vector ghostBall = sight.pos[b] - 2 * Spec::BALL_RADIUS * out;
+  vector in = ghostBall - sight.pos[a];
+  double length = abs(in) + abs(hits[0] - sight.pos[b]) + abs(c - hits[n - 1]);
+  for(int k = 1; k < n; ++k) {
+    length += abs(hits[k] - hits[k - 1]);
+  }
+  if (dot(in, out) < 0.2 * abs(in) || length > reach) {
+    return -10;
+  }
+  if (pathBlocked(sight, a, ghostBall) || pathBlocked(sight, b, hits[0])) {
+    return -10;
+  }
+  for(int k = 0; k < n; ++k) {
+    if (pointBlocked(sight, hits[k], k + 1 < n ? hits[k + 1] : c, b)) {
+      return -10;
+    }
+  }
+  return atan2(in.Y, in.X);
+}
+
+//Kick: hit ball a off the rails in seq into ball b, which goes in the pocket at c. Same checks as bankShot
+template <class Spec>
+double kickShot(const sightIndex &sight, int a, int b, vector c, const int *seq, int n, double reach) {
+  vector out = (c - sight.pos[b]) / abs(c - sight.pos[b]);
+  vector ghostBall = sight.pos[b] - 2 * Spec::BALL_RADIUS * out;
+  vector hits[2];
+  if (!bouncePath(specRails<Spec>(), seq, n, sight.pos[a], ghostBall, hits)) {
+    return -10;
+  }
+  vector last = ghostBall - hits[n - 1];
+  double length = abs(hits[0] - sight.pos[a]) + abs(last) + abs(c - sight.pos[b]);
+  for(int k = 1; k < n; ++k) {
+    length += abs(hits[k] - hits[k - 1]);
+  }
+  if (dot(last, out) < 0.2 * abs(last) || length > reach) {
+    return -10;
+  }
+  if (pathBlocked(sight, b, c) || pathBlocked(sight, a, hits[0])) {
+    return -10;
+  }
+  for(int k = 0; k < n; ++k) {
+    if (pointBlocked(sight, hits[k], k + 1 < n ? hits[k + 1] : ghostBall, a)) {
+      return -10;
+    }
+  }
+  vector first = hits[0] - sight.pos[a];
+  return atan2(first.Y, first.X);
+}
+
+//Gives the best possible angle to hit the cue ball (balls[0]) at
+//idArray is a vector of the id's of balls that we can possibly sink in
+//-10 is the default "we have no good move"
+template <class Spec = nineFoot>
+double getBestMove(state cur, std::vector<int> idArray){
+  sightIndex sight;
+  buildSight<Spec>(sight, cur);
+  double bestMove = -10;
+  double bestRange = 0;
+  vector lowPockets[6], pockets[6], highPockets[6];
+  for(int j = 0; j < 6; ++j){
+    lowPockets[j] = vector(Spec::AIM_LOW[j].x, Spec::AIM_LOW[j].y);
+    pockets[j] = vector(Spec::AIM_MID[j].x, Spec::AIM_MID[j].y);
+    highPockets[j] = vector(Spec::AIM_HIGH[j].x, Spec::AIM_HIGH[j].y);
+  }
+  for(int i = 0; i < (int) idArray.size(); ++i){
+    if(onTable(cur, idArray[i])){
+      int newBall = idArray[i];
+      for(int j = 0; j < 6; ++j){ //Check direct shot
+        double ang1 = directShot<Spec>(sight, 0, newBall, lowPockets[j]);
+        double ang2 = directShot<Spec>(sight, 0, newBall, highPockets[j]);
+        if(ang1 != -10 && ang2 != -10){
+          double diff = ang1 - ang2;
+          if(diff < 0) {diff = -diff;}
+          if(diff > bestRange){
+            bestRange = diff;
+            bestMove = directShot<Spec>(sight, 0, newBall, pockets[j]);
+          }
+        }
+        for(int k = 0; k < (int) idArray.size(); ++k){  //Check comboes
+          if(i != k && onTable(cur, k)){
+            int endBall = idArray[k];
+            double ang1 = comboShot<Spec>(sight, 0, newBall, endBall, lowPockets[j]);
+            double ang2 = comboShot<Spec>(sight, 0, newBall, endBall, highPockets[j]);
+            if(ang1 != -10 && ang2 != -10){
+              double diff = abs(ang1 - ang2);
+              if(diff > bestRange){
+                bestRange = diff;
+                bestMove = comboShot<Spec>(sight, 0, newBall, endBall, pockets[j]);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return bestMove;
+}
+
+template <class Spec = nineFoot>
+double getBestMoveAll(state cur){
+  static const int arr[] = {1,2,3,4,5,6,7,8,9,10,11,12,13,14,15};
+  std::vector<int> v (arr, arr + sizeof(arr) / sizeof(arr[0]) );
+  return getBestMove<Spec>(cur, v);
+}
+
+//A shot the planner could play: the cue ball hit at angle and speed, to sink ball target
+struct candidate {
+  double angle, speed;
+  int target;
+  int cushions; // rails it goes off on the way, 0 for direct shots and combos
+};
+
+//How far off a shot is likely to be when it's actually played: normal errors with a standard deviation of angle
+//radians and of speed as a fraction of the speed. Each candidate is played samples times, with errors from seed
+struct shotNoise {
+  double angle, speed;
+  int samples;
+  unsigned seed;
+};
+
+//How many of a candidate's samples went in, and a 95% confidence interval for its real chance of going in
+struct shotScore {
+  int samples, made;
+  double probability, low, high;
+};
+
+//Wilson's interval, which stays inside [0, 1] and sensible when every sample (or none) went in
+inline void confidence(shotScore &score) {
+  double n = score.samples, z = 1.96;
+  double p = n > 0 ? score.made / n : 0;
+  double mid = (p + z * z / (2 * n)) / (1 + z * z / n);
+  double spread = z * sqrt(p * (1 - p) / n + z * z / (4 * n * n)) / (1 + z * z / n);
+  score.probability = p;
+  score.low = n > 0 ? std::max(0.0, mid - spread) : 0;
+  score.high = n > 0 ? std::min(1.0, mid + spread) : 1;
+}
+
+//Every direct and combo shot getBestMove would consider, aimed at the middle of the pocket and hit at speed
+//With cushions 1 or 2 there are also banks and kicks off up to that many rails
+template <class Spec = nineFoot>
+void listCandidates(state cur, const std::vector<int> &idArray, double speed, std::vector<candidate> &out, int cushions = 0) {
+  sightIndex sight;
+  buildSight<Spec>(sight, cur);
+  out.clear();
+  for(int i = 0; i < (int) idArray.size(); ++i){
+    if(!onTable(cur, idArray[i])) continue;
+    for(int j = 0; j < 6; ++j){
+      vector pocket = vector(Spec::AIM_MID[j].x, Spec::AIM_MID[j].y);
+      double ang = directShot<Spec>(sight, 0, idArray[i], pocket);
+      if (ang != -10) {
+        candidate c = {ang, speed, idArray[i], 0};
+        out.push_back(c);
+      }
+      for(int k = 0; k < (int) idArray.size(); ++k){
+        if(i == k || !onTable(cur, idArray[k])) continue;
+        ang = comboShot<Spec>(sight, 0, idArray[i], idArray[k], pocket);
+        if (ang != -10) {
+          candidate c = {ang, speed, idArray[k], 0};
+          out.push_back(c);
+        }
+      }
+      int rails = cushions > 0 ? specRails<Spec>().size() : 0;
+      double reach = speed * speed / (2 * FRICTION);
+      for(int first = 0; first < rails; ++first) {
+        for(int second = -1; second < (cushions > 1 ? rails : 0); ++second) {
+          if (second == first) continue;
+          int seq[2] = {first, second}, n = second == -1 ? 1 : 2;
+          ang = bankShot<Spec>(sight, 0, idArray[i], pocket, seq, n, reach);
+          if (ang != -10) {
+            candidate c = {ang, speed, idArray[i], n};
+            out.push_back(c);
+          }
+          ang = kickShot<Spec>(sight, 0, idArray[i], pocket, seq, n, reach);
+          if (ang != -10) {
+            candidate c = {ang, speed, idArray[i], n};
+            out.push_back(c);
+          }
+        }
+      }
+    }
+  }
+}
+
+//Plays each of the shots noise.samples times with random errors, spread over pool's threads, and scores it by
+//how often its target went down without the cue ball following it. Rail bounces, jaws and kisses all count,
+//since every sample is a full simulation
+//Samples are simulated a block of shots at a time, so memory stays flat however many candidates there are
+template <class Spec = nineFoot, class Kernel>
+void scoreShots(basicShotPool<Kernel> &pool, state cur, const candidate *shots, int numShots, const shotNoise &noise, shotScore *scores) {
+  int samples = noise.samples > 0 ? noise.samples : 1;
+  int perBlock = std::max(1, 4096 / samples);
+  std::vector<vector> vels(std::min(numShots, perBlock) * samples);
+  std::vector<stopRule> stops(vels.size());
+  std::vector<outcome> outs(vels.size());
+  std::mt19937 random(noise.seed);
+  std::normal_distribution<double> normal;
+  for(int first = 0; first < numShots; first += perBlock) {
+    int count = std::min(perBlock, numShots - first);
+    for(int c = 0; c < count; ++c) {
+      const candidate &shot = shots[first + c];
+      for(int k = 0; k < samples; ++k) {
+        double angle = shot.angle + noise.angle * normal(random);
+        double speed = std::max(0.0, shot.speed * (1 + noise.speed * normal(random)));
+        vels[c * samples + k] = speed * vector(cos(angle), sin(angle));
+        stops[c * samples + k].when = STOP_SCRATCH;
+        stops[c * samples + k].target = shot.target;
+      }
+    }
+    simulateBatch<Spec>(pool, cur, vels.data(), count * samples, outs.data(), stops.data());
+    for(int c = 0; c < count; ++c) {
+      shotScore &score = scores[first + c];
+      score.samples = samples;
+      score.made = 0;
+      for(int k = 0; k < samples; ++k) {
+        const outcome &out = outs[c * samples + k];
+        score.made += out.balls[shots[first + c].target].inPocket != -1 && out.balls[0].inPocket == -1;
+      }
+      confidence(score);
+    }
+  }
+}
+
+//Like getBestMove, but picks the shot most likely to go in when played with noise's errors, rather than the one
+//with the widest window. Hits at speed; best gets the chosen shot's score if given. cushions is as for
+//listCandidates
+template <class Spec = nineFoot, class Kernel>
+double getBestMoveRobust(basicShotPool<Kernel> &pool, state cur, std::vector<int> idArray, double speed, const shotNoise &noise, shotScore *best = NULL, int cushions = 0) {
+  std::vector<candidate> shots;
+  listCandidates<Spec>(cur, idArray, speed, shots, cushions);
+  std::vector<shotScore> scores(shots.size());
+  scoreShots<Spec>(pool, cur, shots.data(), shots.size(), noise, scores.data());
+  int pick = -1;
+  for(int k = 0; k < (int) shots.size(); ++k) {
+    if (pick == -1 || scores[k].probability > scores[pick].probability ||
+        (scores[k].probability == scores[pick].probability && scores[k].low > scores[pick].low)) {
+      pick = k;
+    }
+  }
+  if (pick == -1) {
+    return -10;
+  }
+  if (best) {
+    *best = scores[pick];
+  }
+  return shots[pick].angle;
+}
+
+//How far ahead planAhead looks: depth shots deep, keeping the beam best lines of play at each depth, every shot
+//hit at speed. It stops early once budget seconds have gone. position is what it's worth to have shots left to
+//play at the end of a line, as a fraction of a ball. cushions is as for listCandidates
+struct lookahead {
+  int depth, beam;
+  double speed, budget, position;
+  int cushions;
+};
+
+//A line of play planAhead is following: the shots so far, the table they leave, and how good that is
+struct shotLine {
+  std::vector<candidate> shots;
+  std::vector<ball> balls;
+  int potted;
+  double score;
+};
+
+//Key for a table in planAhead's transposition table: every ball's position to the nearest 5mm, or its pocket
+inline unsigned long long tableKey(const std::vector<ball> &balls) {
+  unsigned long long h = 1469598103934665603ULL;
+  for(size_t i = 0; i < balls.size(); ++i) {
+    bool down = balls[i].inPocket != -1;
+    long long x = down ? -1 - balls[i].inPocket : (long long) floor(balls[i].pos.X / 0.005);
+    long long y = down ? 0 : (long long) floor(balls[i].pos.Y / 0.005);
+    h = (h ^ (unsigned long long) x) * 1099511628211ULL;
+    h = (h ^ (unsigned long long) y) * 1099511628211ULL;
+  }
+  return h;
+}
+
+//Plans a run of shots instead of just the next one, so it can pick a shot that leaves the cue ball somewhere
+//useful. Each line of play is extended by every shot listCandidates finds, simulated to rest over the pool's
+//threads. A line ends when a shot pots nothing or scratches, and only the best opts.beam of the rest carry on
+//to the next depth. Lines that reach a table already reached by a better line are dropped
+//Returns the angle of the first shot of the best line found, -10 if there's nothing to play; line gets the shots
+template <class Spec = nineFoot, class Kernel>
+double planAhead(basicShotPool<Kernel> &pool, state cur, const lookahead &opts, std::vector<candidate> *line = NULL) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<shotLine> beam(1), next;
+  beam[0].balls.assign(cur.balls, cur.balls + cur.numballs);
+  beam[0].potted = 0;
+  beam[0].score = 0;
+  shotLine best = beam[0];
+  std::unordered_map<unsigned long long, double> seen;
+  std::vector<candidate> shots, after;
+  std::vector<int> targets;
+  std::vector<vector> vels;
+  std::vector<stopRule> stops;
+  std::vector<outcome> outs;
+  for(int d = 0; d < opts.depth && !beam.empty(); ++d) {
+    next.clear();
+    for(size_t b = 0; b < beam.size(); ++b) {
+      if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > opts.budget) {
+        break;
+      }
+      const shotLine &from = beam[b];
+      state s = cur;
+      s.balls = const_cast<ball *>(from.balls.data());
+      targets.clear();
+      for(int i = 1; i < s.numballs; ++i) {
+        if (onTable(s, i)) targets.push_back(i);
+      }
+      listCandidates<Spec>(s, targets, opts.speed, shots, opts.cushions);
+      vels.resize(shots.size());
+      outs.resize(shots.size());
+      stops.assign(shots.size(), NO_STOP);
+      for(size_t k = 0; k < shots.size(); ++k) {
+        vels[k] = shots[k].speed * vector(cos(shots[k].angle), sin(shots[k].angle));
+        stops[k].when = STOP_SCRATCH; // a scratch ends the line, wherever the rest stop
+      }
+      simulateBatch<Spec>(pool, s, vels.data(), shots.size(), outs.data(), stops.data());
+      for(size_t k = 0; k < shots.size(); ++k) {
+        shotLine child;
+        child.shots = from.shots;
+        child.shots.push_back(shots[k]);
+        child.balls = outs[k].balls;
+        int gained = 0;
+        for(int i = 1; i < s.numballs; ++i) {
+          gained += onTable(s, i) && child.balls[i].inPocket != -1;
+        }
+        bool over = gained == 0 || child.balls[0].inPocket != -1;
+        child.potted = from.potted + (over ? 0 : gained);
+        child.score = child.potted;
+        if (!over) {
+          state left = s;
+          left.balls = child.balls.data();
+          targets.clear();
+          for(int i = 1; i < left.numballs; ++i) {
+            if (onTable(left, i)) targets.push_back(i);
+          }
+          listCandidates<Spec>(left, targets, opts.speed, after, opts.cushions);
+          child.score += opts.position * after.size() / (after.size() + 4.0);
+          unsigned long long key = tableKey(child.balls);
+          std::unordered_map<unsigned long long, double>::iterator it = seen.find(key);
+          if (it != seen.end() && it->second >= child.score) {
+            continue;
+          }
+          seen[key] = child.score;
+        }
+        if (best.shots.empty() || child.score > best.score) {
+          best = child;
+        }
+        if (!over) {
+          next.push_back(child);
+        }
+      }
+    }
+    std::stable_sort(next.begin(), next.end(), [](const shotLine &a, const shotLine &b) { return a.score > b.score; });
+    if ((int) next.size() > opts.beam) {
+      next.resize(opts.beam);
+    }
+    beam.swap(next);
+  }
+  if (line) {
+    *line = best.shots;
+  }
+  return best.shots.empty() ? -10 : best.shots[0].angle;
+}
+
+//What solveShot came up with: hit the cue ball at angle and speed. error is how far off the aim the target was
+//sent, in radians, and made whether it went down in that pocket without the cue ball following it
+struct shotSolution {
+  double angle, speed, error;
+  bool made;
+  int simulations;
+};
+
+//One of solveShot's trials, played only as far as its outcome is known. Returns the signed angle between where
+//the cue ball sent the target and where it should have gone, NaN if the cue ball hit something else first or
+//nothing at all
+template <class Spec, class Kernel>
+double shotError(basicSimulation<Kernel> &sim, std::vector<ball> &balls, outcome &out, state cur, vector cueVel, int target, int pocket, vector aim, bool &made) {
+  stopRule stop = {STOP_WRONG_FIRST | STOP_SCRATCH, target};
+  simulateOutcome<Spec>(sim, balls, cur, cueVel, stop, out);
+  made = out.balls[target].inPocket == pocket && out.balls[0].inPocket == -1;
+  if (out.firstContact != target) {
+    return NAN;
+  }
+  vector sent = out.firstVel, want = aim - cur.balls[target].pos;
+  return atan2(sent.Y * want.X - sent.X * want.Y, dot(sent, want));
+}
+
+//Where solveShot starts for one aim point: the ghost ball angle, and a speed that gets the target there still
+//rolling at arrive. The target gets BALL_RES of the cue ball's speed along the line of centres
+template <class Spec>
+double ghostStart(state cur, int target, vector aim, double arrive, double &angle) {
+  vector out = (aim - cur.balls[target].pos) / abs(aim - cur.balls[target].pos);
+  vector in = cur.balls[target].pos - 2 * Spec::BALL_RADIUS * out - cur.balls[0].pos;
+  angle = atan2(in.Y, in.X);
+  double along = std::max(dot(in, out) / abs(in), 0.2);
+  double sent = sqrt(arrive * arrive + 2 * FRICTION * abs(aim - cur.balls[target].pos));
+  return sqrt(square(sent / (BALL_RES * along)) + 2 * FRICTION * abs(in));
+}
+
+//Finds how to hit the cue ball to send ball target into pocket, by simulating rather than trusting geometry.
+//Starts from the ghost ball angle directShot would give, then homes in on the angle that sends the target
+//straight at the middle of the pocket with secant steps, each one a simulation. If the line is right but the
+//ball still doesn't drop it tries the low and high aim points, then hits harder. Speed 0 works out a speed
+//that gets the target there still rolling. Gives up after maxSimulations and returns the closest it got
+template <class Spec = nineFoot, class Kernel>
+shotSolution solveShot(basicSimulation<Kernel> &sim, state cur, int target, int pocket, double speed = 0, int maxSimulations = 30) {
+  const double arrive = 0.3, tolerance = 1e-6, maxStep = 0.05;
+  const aimPoint *aims[3] = {Spec::AIM_MID, Spec::AIM_LOW, Spec::AIM_HIGH};
+  int tries = 0;
+  vector aim(aims[0][pocket].x, aims[0][pocket].y);
+  double angle, guess = ghostStart<Spec>(cur, target, aim, arrive, angle);
+  if (speed <= 0) {
+    speed = guess;
+  }
+  std::vector<ball> balls;
+  outcome out;
+  shotSolution best = {angle, speed, NAN, false, 0};
+  double lastAngle = NAN, lastError = NAN;
+  for(int n = 1; n <= maxSimulations; ++n) {
+    bool made;
+    double error = shotError<Spec>(sim, balls, out, cur, speed * vector(cos(angle), sin(angle)), target, pocket, aim, made);
+    //A trial that hit the wrong ball has no error to compare, so it never replaces one that hit the target
+    bool better = error == error &&
+                  (made > best.made || (made == best.made && (best.error != best.error || fabs(error) < fabs(best.error))));
+    if (better) {
+      best.angle = angle, best.speed = speed, best.error = error, best.made = made;
+    }
+    best.simulations = n;
+    if (made && fabs(error) < tolerance) {
+      break;
+    }
+    if (error == error && fabs(error) < tolerance) {
+      //Right line but it didn't drop: the next aim point in the mouth, and harder once they've all been tried
+      ++tries;
+      aim = vector(aims[tries % 3][pocket].x, aims[tries % 3][pocket].y);
+      ghostStart<Spec>(cur, target, aim, arrive, angle);
+      if (tries % 3 == 0) {
+        speed *= 1.25;
+      }
+      lastAngle = lastError = NAN;
+      continue;
+    }
+    double next;
+    if (error != error) {
+      //Hit the wrong ball: back off halfway towards the last angle that didn't, or nudge if there isn't one
+      next = lastError == lastError ? (angle + lastAngle) / 2 : angle + (n % 2 ? 1 : -2) * 1e-3 * n;
+    } else if (lastError == lastError && error != lastError) {
+      next = angle - error * (angle - lastAngle) / (error - lastError);
+    } else {
+      next = angle + (error > 0 ? 1e-4 : -1e-4);
+    }
+    if (error == error) {
+      lastAngle = angle, lastError = error;
+    }
+    angle += std::max(-maxStep, std::min(maxStep, next - angle));
+  }
+  return best;
+}
+
+//Given an angle at which we strike the cue ball, give the vector position of the ghost of the cue ball upon first collision
+template <class Spec = nineFoot>
+vector getGhostImage(state cur, double angle){
+  int n = cur.numballs;
+
+  ball copyCue = ball(vector(cur.balls[0].pos.X, cur.balls[0].pos.Y), -1);
+  copyCue.vel = vector(cos(angle), sin(angle));
+
+  double dt = 10000000;
+  for(int j = 1; j < n; ++j) {
+    if(onTable(cur, j)){
+      double t = collideBalls<Spec>(copyCue, cur.balls[j], dt);
+      if (0 < t && t < dt) {
+        dt = t;
+        TRACE_EVENT(dt, 0, -1, j);
+      }
+    }
+  }
+
+  const tableOutline &table = specOutline<Spec>();
+  for(int j = 0; j < table.pockets.n; ++j) {
+    double t = collidePocket(copyCue, table.pockets, j, dt);
+    if (0 < t && t < dt) {
+      dt = t;
+      TRACE_EVENT(dt, 1, -1, j);
+    }
+  }
+
+  std::vector<double> times(table.cushions.n);
+  cushionContacts(table.cushions, copyCue, Spec::BALL_RADIUS, dt, times.data());
+  for(int j = 0; j < table.cushions.n; ++j) {
+    if (0 < times[j] && times[j] < dt) {
+      dt = times[j];
+      TRACE_EVENT(dt, 2, -1, j);
+    }
+  }
+  copyCue.run(dt);
+  return copyCue.pos;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "pocketpool.h"
+#include "engine.h"
+
+struct pp_simulation {
+  int table;
+  simulation sim;
+  std::vector<ball> balls;
+};
+
+//Where writeFrame puts frames
+struct floatFrames {
+  float *out;
+  int maxFrames, numballs;
+};
+
+//frameSink that writes each frame's positions into the floatFrames passed as context
+void writeFrame(const state &frame, int index, void *context) {
+  floatFrames &f = *(floatFrames *) context;
+  if (index >= f.maxFrames) {
+    return;
+  }
+  float *at = f.out + (size_t) index * f.numballs * 2;
+  for(int j = 0; j < f.numballs; ++j) {
+    const ball &b = frame.balls[j];
+    at[2 * j] = b.inPocket == -1 ? (float) b.pos.X : NAN;
+    at[2 * j + 1] = b.inPocket == -1 ? (float) b.pos.Y : NAN;
+  }
+}
+
+pp_simulation *pp_create(int table) {
+  if (table < PP_NINE_FOOT || table > PP_SNOOKER) {
+    return NULL;
+  }
+  pp_simulation *sim = new pp_simulation();
+  sim->table = table;
+  return sim;
+}
+
+void pp_destroy(pp_simulation *sim) {
+  delete sim;
+}
+
+int pp_max_frames(void) {
+  return MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1;
+}
+
+double pp_time_step(void) {
+  return DEFAULT_TIME_STEP;
+}
+
+int pp_simulate(pp_simulation *sim, int numballs, const double *pos, const double *vel, float *out, int maxFrames) {
+  sim->balls.resize(numballs);
+  for(int i = 0; i < numballs; ++i) {
+    sim->balls[i] = ball(vector(pos[2 * i], pos[2 * i + 1]), i);
+    sim->balls[i].vel = vector(vel[2 * i], vel[2 * i + 1]);
+  }
+  state s;
+  s.time = 0;
+  s.numballs = numballs;
+  s.balls = sim->balls.data();
+  floatFrames frames = {out, maxFrames, numballs};
+  switch (sim->table) {
+    case PP_EIGHT_FOOT: return streamStates<eightFoot>(sim->sim, s, writeFrame, &frames);
+    case PP_SEVEN_FOOT: return streamStates<sevenFoot>(sim->sim, s, writeFrame, &frames);
+    case PP_SNOOKER: return streamStates<snooker>(sim->sim, s, writeFrame, &frames);
+    default: return streamStates<nineFoot>(sim->sim, s, writeFrame, &frames);
+  }
+}
+
+void pp_pockets(const pp_simulation *sim, int *pockets) {
+  for(size_t i = 0; i < sim->sim.balls.size(); ++i) {
+    pockets[i] = sim->sim.balls[i].inPocket;
+  }
+}
@@ -0,0 +1,52 @@
+//Plain C interface to the engine, for hosts that aren't C++: services, Python through ctypes, the app
+//Frames come back in one buffer the caller owns, float[frames][numballs][2], x then y for each ball, and
+//nothing is allocated per frame or per ball. Balls in a pocket are written as NaN
+//
+//Compile pocketpool.cpp in with the rest of the program, alongside any other files that include engine.h, or
+//as a library for hosts that load one
+//    g++ -std=c++11 -O2 -pthread pocketpool.cpp main.cpp -o main
+//    g++ -std=c++11 -O2 -shared -fPIC -pthread pocketpool.cpp -o libpocketpool.so
+//
+//    pp_simulation *sim = pp_create(PP_NINE_FOOT);
+//    float *frames = malloc(pp_max_frames() * numballs * 2 * sizeof(float));
+//    int n = pp_simulate(sim, numballs, pos, vel, frames, pp_max_frames());
+//    pp_destroy(sim);
+#ifndef POCKETPOOL_H
+#define POCKETPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  PP_NINE_FOOT,
+  PP_EIGHT_FOOT,
+  PP_SEVEN_FOOT,
+  PP_SNOOKER
+};
+
+//Scratch space for simulating on one kind of table. Reusing one across shots saves reallocating
+//One per thread, it isn't safe to share
+typedef struct pp_simulation pp_simulation;
+
+//NULL if table isn't one of the PP_ kinds
+pp_simulation *pp_create(int table);
+void pp_destroy(pp_simulation *sim);
+
+//Most frames a shot can take, one every pp_time_step() seconds
+int pp_max_frames(void);
+double pp_time_step(void);
+
+//Simulates numballs balls, ball i starting at pos[2i], pos[2i + 1] with velocity vel[2i], vel[2i + 1], until
+//they stop. Frame f ball i goes to out[(f * numballs + i) * 2] and the one after, for up to maxFrames frames
+//Returns how many frames the shot has, which can be more than maxFrames if out was too small to hold them all
+int pp_simulate(pp_simulation *sim, int numballs, const double *pos, const double *vel, float *out, int maxFrames);
+
+//After pp_simulate, which pocket each ball ended up in, -1 for still on the table
+void pp_pockets(const pp_simulation *sim, int *pockets);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
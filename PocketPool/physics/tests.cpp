@@ -0,0 +1,803 @@
+//Tests for the physics engine
+//  g++ -std=c++11 -pthread tests.cpp -o tests && ./tests
+//Add -DPOOL_TRACE to test the instrumentation too
+#include "engine.h"
+#include "allocCounter.h"
+#include <cstring>
+
+//Cue ball on the left, a full triangle of 15 on the right
+void makeRack(ball *balls, double cueSpeed, double cueAngle, double gap = 1e-4) {
+  balls[0] = ball(vector(0.6, 0.62), 0);
+  balls[0].vel = cueSpeed * vector(cos(cueAngle), sin(cueAngle));
+  int k = 1;
+  double d = 2 * nineFoot::BALL_RADIUS + gap;
+  for(int row = 0; row < 5; ++row) {
+    for(int c = 0; c <= row; ++c) {
+      balls[k] = ball(vector(1.8 + row * d * sqrt(3.) / 2, nineFoot::HEIGHT / 2 + (c - row / 2.) * d), k);
+      ++k;
+    }
+  }
+}
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok) {
+    ++failures;
+  }
+}
+
+//Once a simulation and a frame ring have been used for one shot, the next shot shouldn't allocate at all
+void testNoAllocationsPerShot() {
+  ball balls[16];
+  state s;
+  s.time = 0;
+  s.numballs = 16;
+  s.balls = balls;
+
+  int numFrames = MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1;
+  std::vector<double> times(numFrames);
+  std::vector<ball> storage(numFrames * 16);
+  frameRing ring;
+  simulation sim;
+
+  makeRack(balls, 4, 0.01);
+  initRing(ring, times.data(), storage.data(), numFrames, 16);
+  streamStates(sim, s, pushFrame, &ring);
+
+  makeRack(balls, 6, -0.02);
+  initRing(ring, times.data(), storage.data(), numFrames, 16);
+  long before = allocations;
+  int count = streamStates(sim, s, pushFrame, &ring);
+  check(allocations == before, "no allocations for a shot once warmed up");
+  check(ring.count == count, "every frame reached the ring");
+
+  //The ring should hold exactly what allStates stores
+  int stored;
+  state *stateList = allStates(s, &stored);
+  bool same = stored == count;
+  for(int i = 0; i < count && same; ++i) {
+    state f = ringFrame(ring, i);
+    same = same && f.time == stateList[i].time;
+    for(int j = 0; j < 16; ++j) {
+      same = same && f.balls[j].pos == stateList[i].balls[j].pos;
+    }
+  }
+  freeStates(stateList, numFrames);
+  check(same, "ring frames match allStates");
+}
+
+//Seeking into a recorded trajectory should land where stepping through the shot frame by frame does
+void testTrajectorySeek() {
+  ball balls[16];
+  state s;
+  s.time = 0;
+  s.numballs = 16;
+  s.balls = balls;
+  makeRack(balls, 5, 0.015);
+
+  simulation sim;
+  trajectory tr;
+  recordTrajectory(sim, s, MAX_ANIMATION_LENGTH, tr);
+  check(tr.keys.size() < 16 * (MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1), "trajectory is smaller than the frames");
+
+  int maxFrames = MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1, numFrames;
+  state *stateList = allStates(s, &numFrames);
+  ball seek[16];
+  double worst = 0;
+  bool pockets = true;
+  //Backwards, so every seek is random access rather than following on from the last one
+  for(int i = numFrames - 1; i >= 0; --i) {
+    state f = trajectoryAt(tr, stateList[i].time, seek);
+    for(int j = 0; j < 16; ++j) {
+      worst = std::max(worst, abs(f.balls[j].pos - stateList[i].balls[j].pos));
+      pockets = pockets && f.balls[j].inPocket == stateList[i].balls[j].inPocket;
+    }
+  }
+  freeStates(stateList, maxFrames);
+  check(worst < 1e-9, "trajectory positions match allStates");
+  check(pockets, "trajectory pockets match allStates");
+
+  //Stored as float it should take half the room and put the balls in nearly the same places
+  floatTrajectory small;
+  recordTrajectory(sim, s, MAX_ANIMATION_LENGTH, small);
+  ball exact[16];
+  worst = 0;
+  for(double t = 0; t <= tr.end; t += DEFAULT_TIME_STEP / 3) {
+    trajectoryAt(tr, t, exact);
+    trajectoryAt(small, t, seek);
+    for(int j = 0; j < 16; ++j) {
+      worst = std::max(worst, abs(exact[j].pos - seek[j].pos));
+    }
+  }
+  check(small.keys.size() == tr.keys.size() && 2 * sizeof(small.keys[0]) == sizeof(tr.keys[0]) && worst < 1e-5,
+        "floatTrajectory is half the size and within 1e-5 m");
+}
+
+//A shot that dies out before MAX_ANIMATION_LENGTH should stop there, with the balls at rest in the last frame
+void testStopsAtRest() {
+  ball balls[2];
+  state s;
+  s.time = 0;
+  s.numballs = 2;
+  s.balls = balls;
+  balls[0] = ball(vector(0.6, 0.62), 0);
+  balls[0].vel = vector(0.03, 0);
+  balls[1] = ball(vector(1.8, 0.3), 1);
+
+  int maxFrames = MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1, numFrames;
+  state *stateList = allStates(s, &numFrames);
+  state last = stateList[numFrames - 1];
+  check(numFrames < maxFrames, "slow shot stops early");
+  check(last.time >= balls[0].stopTime(), "last frame is after the ball stops");
+  check(abs(last.balls[0].pos - balls[0].posAt(balls[0].stopTime())) < 1e-12, "ball ends where friction stops it");
+  freeStates(stateList, maxFrames);
+
+  //With nothing else on the table, the only steps are its cushions and coming to rest
+  balls[0].vel = vector(1.8, 0.9);
+  s.numballs = 1;
+  simulation sim;
+  initSimulation(sim, s);
+  int steps = 0, cushions = 0;
+  while (step(sim, MAX_ANIMATION_LENGTH)) {
+    ++steps;
+    cushions += sim.lastEvent.type == 2;
+  }
+  check(cushions > 0 && steps == cushions + 1, "lone ball only stops for its cushions");
+}
+
+//From the middle of the table, a ball rolled at the center of any pocket should go in, whichever table it's on
+template <class Spec>
+bool sinksEveryPocket() {
+  bool ok = true;
+  for(int j = 0; j < 6; ++j) {
+    ball b(vector(Spec::WIDTH / 2, Spec::HEIGHT / 2), 0);
+    vector aim = vector(Spec::POCKETS[j].x, Spec::POCKETS[j].y) - b.pos;
+    b.vel = 2.0 * aim / abs(aim);
+    state s;
+    s.time = 0;
+    s.numballs = 1;
+    s.balls = &b;
+    simulation sim;
+    outcome out;
+    std::vector<ball> balls;
+    simulateShot<Spec>(sim, balls, s, b.vel, out);
+    ok = ok && out.balls[0].inPocket == j;
+  }
+  return ok;
+}
+
+void testTablePresets() {
+  check(sinksEveryPocket<nineFoot>(), "nine foot pockets");
+  check(sinksEveryPocket<eightFoot>(), "eight foot pockets");
+  check(sinksEveryPocket<sevenFoot>(), "seven foot pockets");
+  check(sinksEveryPocket<snooker>(), "snooker pockets");
+}
+
+//Runs one ball from (x, y) at velocity vel until the table is at rest
+ball rollOne(simulation &sim, double x, double y, vector vel) {
+  ball b(vector(x, y), 0);
+  b.vel = vel;
+  state s;
+  s.time = 0;
+  s.numballs = 1;
+  s.balls = &b;
+  initSimulation(sim, s);
+  while (step(sim, MAX_ANIMATION_LENGTH)) {}
+  return sim.cur.balls[0];
+}
+
+//The short rails have no side pocket, so the middle of one has to bounce a ball back like anywhere else
+//A table read in at runtime should then play the same way: a 1m box with one pocket in the top left corner
+void testCushions() {
+  simulation sim;
+  ball end = rollOne(sim, nineFoot::WIDTH / 2, nineFoot::HEIGHT / 2, vector(-2, 0));
+  check(end.inPocket == -1 && end.pos.X > 0 && end.pos.X < nineFoot::WIDTH, "short rail bounces the ball back");
+
+  FILE *f = fopen("outline_test.txt", "w");
+  fprintf(f, "# box\ncushion 0.1 0 1 0\ncushion 1 0 1 1\ncushion 1 1 0 1\ncushion 0 1 0 0.1 0.5\n\npocket 0 0 0.1\n");
+  fclose(f);
+  tableOutline box;
+  bool loaded = loadOutline("outline_test.txt", nineFoot::BALL_RADIUS, box);
+  remove("outline_test.txt");
+  check(loaded && box.cushions.n == 4 && box.pockets.n == 1, "outline loads");
+  sim.outline = &box;
+  end = rollOne(sim, 0.5, 0.5, vector(-1, -1));
+  check(end.inPocket == 0, "ball sinks in a loaded pocket");
+  end = rollOne(sim, 0.5, 0.5, vector(0, 1.5));
+  check(end.inPocket == -1 && end.pos.Y < 1 && abs(end.pos.X - 0.5) < 1e-12, "ball bounces off a loaded cushion");
+}
+
+//The planner's line of sight index has to agree with checking every ball, including on a crowded table
+void testSightIndex() {
+  srand(7);
+  ball balls[16];
+  state s;
+  s.time = 0;
+  s.numballs = 16;
+  s.balls = balls;
+  int wrong = 0;
+  for(int it = 0; it < 200; ++it) {
+    for(int i = 0; i < 16; ++i) {
+      balls[i] = ball(vector(0.03 + rnd() + 1.25, 0.03 + rnd() + 0.6), i);
+    }
+    if (it % 2 == 0) {
+      makeRack(balls, 0, 0);
+    }
+    sightIndex sight;
+    buildSight<nineFoot>(sight, s);
+    for(int q = 0; q < 200; ++q) {
+      int from = rand() % 16;
+      vector to = q % 2 ? balls[rand() % 16].pos : vector(2.5 * rand() / RAND_MAX, 1.25 * rand() / RAND_MAX);
+      wrong += pathBlocked(sight, from, to) != isCollision<nineFoot>(s, balls[from], ball(to, -1));
+    }
+  }
+  check(wrong == 0, "sight index matches isCollision");
+
+  //A target that's gone down isn't there to aim at, whatever its place in idArray
+  ball two[2] = {ball(vector(0.6, 0.62), 0), ball(vector(1.8, 0.62), 1)};
+  two[1].inPocket = 2;
+  state gone = {0, 2, two};
+  check(getBestMove<nineFoot>(gone, std::vector<int>(1, 1)) == -10, "getBestMove skips pocketed targets");
+}
+
+//With the same aiming error, a short straight shot should go in more often than a long thin cut, and the
+//robust planner should pick it
+void testRobustScoring() {
+  ball balls[3] = {ball(vector(0.6, 0.6), 0), ball(vector(0.25, 0.25), 1), ball(vector(1.25, 0.9), 2)};
+  state s;
+  s.time = 0;
+  s.numballs = 3;
+  s.balls = balls;
+  sightIndex sight;
+  buildSight<nineFoot>(sight, s);
+  candidate shots[2] = {
+    {directShot<nineFoot>(sight, 0, 1, vector(0, 0)), 2, 1, 0},
+    {directShot<nineFoot>(sight, 0, 2, vector(nineFoot::WIDTH / 2, nineFoot::HEIGHT + nineFoot::SIDE_RADIUS / 2)), 2, 2, 0}
+  };
+  shotNoise noise = {0.01, 0.05, 100, 1};
+  shotScore scores[2];
+  shotPool pool(2);
+  scoreShots<nineFoot>(pool, s, shots, 2, noise, scores);
+  check(scores[0].probability > scores[1].probability, "straight shot scores above a thin cut");
+  check(scores[0].low <= scores[0].probability && scores[0].probability <= scores[0].high, "interval holds the estimate");
+
+  std::vector<int> ids;
+  ids.push_back(1), ids.push_back(2);
+  shotScore best;
+  double angle = getBestMoveRobust<nineFoot>(pool, s, ids, 2, noise, &best);
+  check(abs(angle - shots[0].angle) < 1e-12 && best.made == scores[0].made, "robust planner picks the straight shot");
+
+  basicShotPool<float> roundedPool(2);
+  shotScore roundedBest;
+  double roundedAngle = getBestMoveRobust<nineFoot>(roundedPool, s, ids, 2, noise, &roundedBest);
+  check(roundedAngle == angle && roundedBest.made == best.made, "robust planner picks the same on a float pool");
+}
+
+//Two easy balls: looking two shots ahead should find a line that pots both, starting with a shot that goes in
+void testLookahead() {
+  ball balls[3] = {ball(vector(0.6, 0.6), 0), ball(vector(0.25, 0.25), 1), ball(vector(2.2, 0.95), 2)};
+  state s;
+  s.time = 0;
+  s.numballs = 3;
+  s.balls = balls;
+  lookahead opts = {2, 8, 1.5, 10, 0.5, 0};
+  shotPool pool(2);
+  std::vector<candidate> line;
+  double angle = planAhead<nineFoot>(pool, s, opts, &line);
+  check(line.size() == 2 && angle == line[0].angle, "lookahead finds a two ball run");
+  if (line.empty()) {
+    return;
+  }
+
+  simulation sim;
+  std::vector<ball> scratch;
+  outcome out;
+  simulateShot<nineFoot>(sim, scratch, s, line[0].speed * vector(cos(angle), sin(angle)), out);
+  check(out.balls[line[0].target].inPocket != -1 && out.balls[0].inPocket == -1, "first shot of the run goes in");
+}
+
+//Banks and kicks come from mirror images of pockets and ghost balls, so most of the ones listed should really go
+//in when played, the same as direct shots
+void testBanks() {
+  srand(11);
+  ball balls[4];
+  state s;
+  s.time = 0;
+  s.numballs = 4;
+  s.balls = balls;
+  std::vector<int> ids;
+  ids.push_back(1), ids.push_back(2), ids.push_back(3);
+  simulation sim;
+  std::vector<ball> scratch;
+  outcome out;
+  int made = 0, total = 0;
+  for(int it = 0; it < 20; ++it) {
+    for(int i = 0; i < 4; ++i) {
+      balls[i] = ball(vector(1.25 + 2 * rnd(), 0.625 + rnd()), i);
+    }
+    std::vector<candidate> shots;
+    listCandidates<nineFoot>(s, ids, 3, shots, 2);
+    for(size_t k = 0; k < shots.size(); ++k) {
+      if (shots[k].cushions == 0) continue;
+      simulateShot<nineFoot>(sim, scratch, s, shots[k].speed * vector(cos(shots[k].angle), sin(shots[k].angle)), out);
+      made += out.balls[shots[k].target].inPocket != -1;
+      ++total;
+    }
+  }
+  check(total > 100 && made > 0.6 * total, "banks and kicks go in");
+}
+
+void testSolveShot() {
+  ball balls[3];
+  balls[0] = ball(vector(1.4, 1.0), 0);
+  balls[1] = ball(vector(2.0, 0.5), 1);
+  balls[2] = ball(vector(0.8, 0.4), 2);
+  state s;
+  s.time = 0;
+  s.numballs = 3;
+  s.balls = balls;
+  simulation sim;
+  shotSolution r = solveShot<nineFoot>(sim, s, 1, 2);
+  check(r.made && r.simulations <= 10, "solver pots the ball in a few simulations");
+  std::vector<ball> scratch;
+  outcome out;
+  simulateShot<nineFoot>(sim, scratch, s, r.speed * vector(cos(r.angle), sin(r.angle)), out);
+  check(out.balls[1].inPocket == 2 && out.balls[0].inPocket == -1, "solved shot goes in the asked pocket");
+
+  //Two balls crowd the cue ball, so some of the secant steps clip one of them before the target. Those trials
+  //have no error to go by, and mustn't be what comes back
+  ball crowded[6] = {ball(vector(1.0499, 0.5397), 0), ball(vector(2.1848, 1.1355), 1), ball(vector(0.5150, 0.9332), 2),
+                     ball(vector(1.8046, 0.4605), 3), ball(vector(1.0715, 0.4154), 4), ball(vector(1.0808, 0.6292), 5)};
+  s.numballs = 6;
+  s.balls = crowded;
+  r = solveShot<nineFoot>(sim, s, 1, 2);
+  simulateShot<nineFoot>(sim, scratch, s, r.speed * vector(cos(r.angle), sin(r.angle)), out);
+  check(r.error == r.error && out.firstContact == 1, "solver keeps a trial that hit the target over blocked ones");
+}
+
+void testAimSession() {
+  ball balls[3];
+  balls[0] = ball(vector(0.6, 0.6), 0);
+  balls[1] = ball(vector(1.5, 0.7), 1);
+  balls[2] = ball(vector(2.0, 0.3), 2);
+  state s;
+  s.time = 0;
+  s.numballs = 3;
+  s.balls = balls;
+  aimSession aiming(4096, 0.02, 4);
+  aimAt<nineFoot>(aiming, s, 0.11, 1.5);
+  for(int wait = 0; wait < 5000; ++wait) {
+    std::lock_guard<std::mutex> guard(aiming.lock);
+    if (aiming.cache.size() == 11) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::shared_ptr<const trajectory> near = releaseAim<nineFoot>(aiming, s, 0.11 + 2 * M_PI / 4096, 1.5);
+  check(aiming.hits == 1 && aiming.misses == 0, "released aim was already speculated on");
+  std::shared_ptr<const trajectory> far = releaseAim<nineFoot>(aiming, s, 2.0, 1.5);
+  check(aiming.misses == 1, "aim nobody speculated on is recorded on release");
+
+  //Both have to be the rounded shots, exactly as recordTrajectory has them
+  const std::shared_ptr<const trajectory> got[2] = {near, far};
+  const double angles[2] = {0.11 + 2 * M_PI / 4096, 2.0};
+  bool same = true;
+  for(int k = 0; k < 2; ++k) {
+    ball start[3] = {balls[0], balls[1], balls[2]};
+    aimSession::key key = aimKey(aiming, s, angles[k], 1.5);
+    start[0].vel = aimVelocity(aiming, key);
+    state b = s;
+    b.balls = start;
+    simulation sim;
+    trajectory tr;
+    recordTrajectory<nineFoot>(sim, b, MAX_ANIMATION_LENGTH, tr);
+    same = same && tr.end == got[k]->end && tr.keys.size() == got[k]->keys.size();
+    for(size_t i = 0; same && i < tr.keys.size(); ++i) {
+      same = tr.keys[i].pos == got[k]->keys[i].pos && tr.keys[i].time == got[k]->keys[i].time;
+    }
+  }
+  check(same, "cached trajectories match recording the rounded aim");
+}
+
+void testAsyncShot() {
+  ball balls[3];
+  balls[0] = ball(vector(0.5, 0.6), 0);
+  balls[1] = ball(vector(1.5, 0.7), 1);
+  balls[2] = ball(vector(2.0, 0.3), 2);
+  balls[0].vel = vector(2.5, 0.2);
+  state s;
+  s.time = 0;
+  s.numballs = 3;
+  s.balls = balls;
+  int numFrames;
+  state *frames = allStates(s, &numFrames);
+
+  //A ring much smaller than the shot, so the thread has to keep waiting for the reader
+  asyncShot shot;
+  startShot(shot, s, 4);
+  ball storage[3];
+  state frame;
+  int pulled = 0;
+  bool same = true;
+  while (!shotOver(shot)) {
+    if (!pullFrame(shot, frame, storage)) {
+      std::this_thread::yield();
+      continue;
+    }
+    for(int j = 0; j < 3; ++j) {
+      same = same && pulled < numFrames && storage[j].pos == frames[pulled].balls[j].pos;
+    }
+    ++pulled;
+  }
+  check(same && pulled == numFrames, "async frames match streamStates");
+  freeStates(frames, numFrames);
+
+  startShot(shot, s, 4);
+  while (!pullFrame(shot, frame, storage)) {
+    std::this_thread::yield();
+  }
+  cancelShot(shot);
+  int left = 0;
+  while (pullFrame(shot, frame, storage)) {
+    ++left;
+  }
+  check(shotOver(shot) && left <= 4, "cancelled shot stops making frames");
+
+  //Nobody reading: once the ring fills the thread should sleep on room, not spin, and still wake up to be cancelled
+  //The deadline only keeps a spinning thread from hanging the test, it isn't what's checked
+  startShot(shot, s, 4);
+  std::chrono::steady_clock::time_point giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (shot.waits.load() == 0 && !shotOver(shot) && std::chrono::steady_clock::now() < giveUp) {
+    std::this_thread::yield();
+  }
+  cancelShot(shot);
+  check(shot.waits.load() > 0 && shot.written.load() == 4, "full ring sleeps instead of spinning");
+}
+
+void testPreview() {
+  ball balls[16];
+  makeRack(balls, 5, 0.02);
+  state s;
+  s.time = 0;
+  s.numballs = 16;
+  s.balls = balls;
+  simulation sim;
+  trajectory full, quick;
+  previewBudget none = {0, 0, 0};
+  check(recordPreview(sim, s, MAX_ANIMATION_LENGTH, none, full), "unlimited preview runs to rest");
+
+  //Stopped after a few collisions, the preview has to be the start of the full shot
+  previewBudget three = {0, 0, 3};
+  bool rested = recordPreview(sim, s, MAX_ANIMATION_LENGTH, three, quick);
+  bool prefix = quick.end > 0 && quick.end < full.end;
+  ball a[16], b[16];
+  for(int k = 0; prefix && k <= 10; ++k) {
+    double t = quick.end * k / 10;
+    trajectoryAt(quick, t, a);
+    trajectoryAt(full, t, b);
+    for(int i = 0; i < 16; ++i) {
+      prefix = prefix && abs(a[i].pos - b[i].pos) < 1e-12;
+    }
+  }
+  check(!rested && prefix, "collision budget gives the start of the shot");
+
+  previewBudget clock = {1e-9, 0, 0};
+  rested = recordPreview(sim, s, MAX_ANIMATION_LENGTH, clock, quick);
+  check(!rested && quick.end < full.end, "time budget stops early");
+}
+
+#ifdef POOL_TRACE
+//The trace's counts have to agree with what stepping the simulation by hand sees
+void testTrace() {
+  ball balls[16];
+  makeRack(balls, 5, 0.02);
+  state s;
+  s.time = 0;
+  s.numballs = 16;
+  s.balls = balls;
+  simulation sim;
+  resetTrace();
+  initSimulation(sim, s);
+  long steps = 0, events[3] = {0, 0, 0};
+  event last;
+  last.type = last.i = last.j = -1;
+  while (step(sim, MAX_ANIMATION_LENGTH)) {
+    ++steps;
+    if (sim.lastEvent.type != -1) {
+      ++events[sim.lastEvent.type];
+      last = sim.lastEvent;
+    }
+  }
+  traceLog &log = threadTrace();
+  check(log.steps == steps && log.events[0] == events[0] && log.events[1] == events[1] && log.events[2] == events[2],
+        "trace counts every step and event");
+  const traceEvent &e = log.ring[(log.written - 1) % TRACE_CAPACITY];
+  check(log.pairTests > 0 && e.type == last.type && e.i == last.i && e.j == last.j, "trace ring ends with the last event");
+}
+#endif
+
+//A frozen rack left alone while the cue ball rolls around away from it shouldn't move, be rebinned or,
+//when traced, cost a single pair test
+void testSleeping() {
+  ball balls[16];
+  makeRack(balls, 0, 0, 0);
+  balls[0].vel = vector(-0.5, 0.1);
+  state s;
+  s.time = 0;
+  s.numballs = 16;
+  s.balls = balls;
+  simulation sim;
+#ifdef POOL_TRACE
+  resetTrace();
+#endif
+  initSimulation(sim, s);
+  std::vector<int> slots(sim.slot);
+  bool kept = true, still = true;
+  int windows = 0;
+  while (step(sim, MAX_ANIMATION_LENGTH)) {
+    ++windows;
+    for(int i = 1; i < 16; ++i) {
+      kept = kept && sim.slot[i] == slots[i];
+      still = still && memcmp(&sim.cur.balls[i].pos, &balls[i].pos, sizeof(vector)) == 0;
+    }
+  }
+  check(windows > 1 && kept, "asleep balls keep their slots from window to window");
+  check(still, "asleep balls don't move by a single bit");
+#ifdef POOL_TRACE
+  check(threadTrace().pairTests == 0 && threadTrace().events[2] > 0, "asleep balls aren't tested against each other");
+#endif
+}
+
+void testOutcome() {
+  ball balls[3];
+  balls[0] = ball(vector(1.4, 1.0), 0);
+  balls[1] = ball(vector(2.0, 0.5), 1);
+  balls[2] = ball(vector(0.8, 0.4), 2);
+  state s;
+  s.time = 0;
+  s.numballs = 3;
+  s.balls = balls;
+  simulation sim;
+  std::vector<ball> scratch;
+  outcome full, cut;
+  shotSolution r = solveShot<nineFoot>(sim, s, 1, 2);
+  vector vel = r.speed * vector(cos(r.angle), sin(r.angle));
+  simulateShot<nineFoot>(sim, scratch, s, vel, full);
+  check(full.firstContact == 1 && full.stopped == 0 && full.balls[1].inPocket == 2, "outcome has the first contact and what went in");
+
+  stopRule potted = {STOP_POTTED, 1};
+  simulateOutcome<nineFoot>(sim, scratch, s, vel, potted, cut);
+  check(cut.stopped == STOP_POTTED && cut.balls[1].inPocket == 2 && cut.time < full.time, "stops once the target drops");
+
+  stopRule wrong = {STOP_WRONG_FIRST, 2};
+  simulateOutcome<nineFoot>(sim, scratch, s, vel, wrong, cut);
+  check(cut.stopped == STOP_WRONG_FIRST && cut.firstContact == 1 && cut.balls[1].inPocket == -1, "stops at a wrong first contact");
+}
+
+//The float kernels only ever let through more than double's, and everything they let through is decided in
+//double, so a floatSimulation plays out exactly the same shot
+void testFloatKernels() {
+  const double R = nineFoot::BALL_RADIUS;
+  std::mt19937 gen(24);
+  std::uniform_real_distribution<double> u(0, 1);
+  ballArrays exact;
+  basicBallArrays<float> rounded;
+  exact.resize(64);
+  rounded.resize(64);
+  std::vector<int> a(64), b(64);
+  const tableOutline &table = specOutline<nineFoot>();
+  std::vector<double> times(table.cushions.n), roundedTimes(table.cushions.n);
+  bool superset = true, sameCushions = true;
+  for(int trial = 0; trial < 2000; ++trial) {
+    ball p(vector(u(gen) * nineFoot::WIDTH, u(gen) * nineFoot::HEIGHT), 0);
+    p.vel = 6.0 * vector(u(gen) - 0.5, u(gen) - 0.5);
+    if (trial % 4 == 0) {
+      //Rolling along a rail, just in reach of it or just out
+      p.pos = vector(p.pos.X, nineFoot::HEIGHT - R + (u(gen) - 0.5) * 1e-6);
+      p.vel = vector(3, (u(gen) - 0.5) * 1e-6);
+    }
+    double horizon = u(gen);
+    for(int k = 0; k < 64; ++k) {
+      ball q(vector(u(gen) * nineFoot::WIDTH, u(gen) * nineFoot::HEIGHT), k);
+      if (k % 2) {
+        //Sitting just about where p would graze it
+        vector along = p.posAt(u(gen) * horizon), side = vector(-p.vel.Y, p.vel.X) / abs(p.vel);
+        q.pos = along + (2 * R + (u(gen) - 0.5) * 1e-6) * side;
+      } else {
+        q.vel = 3.0 * vector(u(gen) - 0.5, u(gen) - 0.5);
+      }
+      exact.store(k, q);
+      exact.reach[k] = 2 * R;
+      exact.alive[k] = k % 7 != 0;
+      rounded.copy(k, exact);
+    }
+    int n = nearby(exact, 0, 64, p, horizon, a.data()), m = nearby(rounded, 0, 64, p, horizon, b.data());
+    for(int k = 0; k < n; ++k) {
+      superset = superset && std::find(b.begin(), b.begin() + m, a[k]) != b.begin() + m;
+    }
+    cushionContacts(table.cushions, p, R, HUGE_VAL, times.data());
+    cushionContacts(table.roundedCushions, table.cushions, p, R, HUGE_VAL, roundedTimes.data());
+    sameCushions = sameCushions && times == roundedTimes;
+  }
+  std::vector<int> slots(64);
+  for(int k = 0; k < 64; ++k) {
+    slots[k] = k;
+  }
+  advance(exact, slots, 0.3);
+  advance(rounded, slots, 0.3);
+  double drift = 0;
+  for(int k = 0; k < 64; ++k) {
+    drift = std::max(drift, std::max(fabs(exact.x[k] - rounded.x[k]), fabs(exact.y[k] - rounded.y[k])));
+  }
+  check(superset, "float nearby keeps every ball double does");
+  check(drift < 1e-6, "float advance stays with double's");
+  check(sameCushions, "float cushion kernel gives double's times");
+
+  simulation sim;
+  basicSimulation<float> roundedSim;
+  std::vector<ball> scratch;
+  outcome x, y;
+  bool same = true;
+  for(int shot = 0; shot < 40; ++shot) {
+    std::vector<ball> balls(16);
+    makeRack(balls.data(), 4 + shot % 5, (u(gen) - 0.5) * 0.05);
+    if (shot % 2) {
+      for(int i = 1; i < 16; ++i) {
+        balls[i].pos = vector(0.1 + (i % 5) * 0.5 + u(gen) * 0.3, 0.1 + (i / 5) * 0.35 + u(gen) * 0.2);
+      }
+    }
+    state s;
+    s.time = 0;
+    s.numballs = 16;
+    s.balls = balls.data();
+    simulateShot<nineFoot>(sim, scratch, s, balls[0].vel, x);
+    simulateShot<nineFoot>(roundedSim, scratch, s, balls[0].vel, y);
+    same = same && x.time == y.time && x.firstContact == y.firstContact;
+    for(int i = 0; i < 16; ++i) {
+      same = same && x.balls[i].pos == y.balls[i].pos && x.balls[i].inPocket == y.balls[i].inPocket;
+    }
+  }
+  check(same, "float kernels play out the same shots as double");
+
+  //And so does a whole batch on a pool of them, stop rules and all
+  std::vector<ball> balls(16);
+  makeRack(balls.data(), 0, 0);
+  state s;
+  s.time = 0;
+  s.numballs = 16;
+  s.balls = balls.data();
+  std::vector<vector> vels(32);
+  std::vector<stopRule> stops(32);
+  for(int k = 0; k < 32; ++k) {
+    vels[k] = (1 + u(gen) * 6) * vector(cos((u(gen) - 0.5) * 0.4), sin((u(gen) - 0.5) * 0.4));
+    stops[k].when = k % 3 == 0 ? STOP_SCRATCH | STOP_POTTED : 0;
+    stops[k].target = 1 + k % 15;
+  }
+  std::vector<outcome> xs(32), ys(32);
+  shotPool pool(2);
+  basicShotPool<float> roundedPool(2);
+  simulateBatch<nineFoot>(pool, s, vels.data(), 32, xs.data(), stops.data());
+  simulateBatch<nineFoot>(roundedPool, s, vels.data(), 32, ys.data(), stops.data());
+  same = true;
+  for(int k = 0; k < 32; ++k) {
+    same = same && xs[k].time == ys[k].time && xs[k].firstContact == ys[k].firstContact && xs[k].stopped == ys[k].stopped;
+    for(int i = 0; i < 16; ++i) {
+      same = same && xs[k].balls[i].pos == ys[k].balls[i].pos && xs[k].balls[i].inPocket == ys[k].balls[i].inPocket;
+    }
+  }
+  check(same, "a float pool's batch comes out the same as double's");
+}
+
+//Balls frozen together take a hit in the same step, the way a cradle passes it along to the far end at once
+void testContactClusters() {
+  const double R = nineFoot::BALL_RADIUS;
+  ball line[3];
+  for(int i = 0; i < 3; ++i) {
+    line[i] = ball(vector(1.0 + (i == 0 ? -0.2 : 2 * R * i), 0.6), i);
+  }
+  line[0].vel = vector(2, 0);
+  state s;
+  s.time = 0;
+  s.numballs = 3;
+  s.balls = line;
+  simulation sim;
+  initSimulation(sim, s);
+  while (step(sim, MAX_ANIMATION_LENGTH) && sim.lastEvent.type == -1) {
+  }
+  vector far = sim.cur.balls[2].vel, first = sim.cur.balls[0].vel;
+  check(sim.lastEvent.type == 0 && abs(first) < 1e-9 && abs(sim.cur.balls[1].vel) < 1e-9 && far.X > 1.5,
+        "a hit goes through touching balls in one step");
+
+  //A frozen rack shouldn't break into bursts of collisions microseconds apart, or overlap
+  ball rack[16];
+  makeRack(rack, 6, 0, 0);
+  s.numballs = 16;
+  s.balls = rack;
+  initSimulation(sim, s);
+  int bursts = 0;
+  double last = -1, overlap = 0;
+  while (step(sim, MAX_ANIMATION_LENGTH)) {
+    if (sim.lastEvent.type == 0) {
+      bursts += sim.cur.time - last < 1e-6;
+      last = sim.cur.time;
+    }
+    for(int i = 0; i < 16; ++i) {
+      for(int j = i + 1; j < 16; ++j) {
+        if (onTable(sim.cur, i) && onTable(sim.cur, j)) {
+          overlap = std::max(overlap, 2 * R - abs(sim.cur.balls[i].pos - sim.cur.balls[j].pos));
+        }
+      }
+    }
+  }
+  check(bursts == 0 && overlap < 1e-9, "frozen rack breaks without bursts or overlaps");
+
+  //Racked with 0.1 mm between balls, the break should still go through the rack as one cluster
+  makeRack(rack, 6, 0);
+  initSimulation(sim, s);
+  int early = 0;
+  last = -1;
+  while (step(sim, MAX_ANIMATION_LENGTH)) {
+    if (sim.lastEvent.type == 0) {
+      last = last < 0 ? sim.cur.time : last;
+      early += sim.cur.time - last < 1e-3;
+    }
+  }
+  check(early == 1, "loosely racked balls take the break together");
+}
+
+//Snapshots own their balls: the frames should match allStates', and changing a copy leaves the original alone
+void testSnapshots() {
+  ball balls[16];
+  state s;
+  s.time = 0;
+  s.numballs = 16;
+  s.balls = balls;
+  makeRack(balls, 5, 0.015);
+
+  int numFrames;
+  state *stateList = allStates(s, &numFrames);
+  std::vector<fixedState<16> > frames;
+  std::vector<dynamicState> dynamicFrames;
+  bool same = allStates(s, frames) == numFrames && allStates(s, dynamicFrames) == numFrames;
+  for(int i = 0; same && i < numFrames; ++i) {
+    for(int j = 0; j < 16; ++j) {
+      same = same && frames[i].balls[j].pos == stateList[i].balls[j].pos && dynamicFrames[i].balls[j].pos == stateList[i].balls[j].pos;
+    }
+  }
+  freeStates(stateList, MAX_ANIMATION_LENGTH / DEFAULT_TIME_STEP + 1);
+  check(same, "snapshots match allStates");
+
+  fixedState<16> copy = frames[0];
+  copy.balls[0].pos = vector();
+  dynamicState dynamicCopy = dynamicFrames[0];
+  dynamicCopy.balls[0].pos = vector();
+  check(frames[0].balls[0].pos == balls[0].pos && dynamicFrames[0].balls[0].pos == balls[0].pos, "changing a snapshot's copy leaves it alone");
+
+  fixedState<4> small(s);
+  check(small.numballs == 4 && !small.add(balls[4]) && dynamicFrames[0].add(balls[4]), "fixedState stops at its capacity");
+}
+
+int main() {
+  testNoAllocationsPerShot();
+  testTrajectorySeek();
+  testStopsAtRest();
+  testTablePresets();
+  testCushions();
+  testSightIndex();
+  testRobustScoring();
+  testLookahead();
+  testBanks();
+  testSolveShot();
+  testAimSession();
+  testAsyncShot();
+  testPreview();
+  testOutcome();
+  testFloatKernels();
+  testContactClusters();
+  testSnapshots();
+#ifdef POOL_TRACE
+  testTrace();
+#endif
+  testSleeping();
+  return failures == 0 ? 0 : 1;
+}